@@ -0,0 +1,91 @@
+// Copyright 2023, Gabriel Foust, All rights reserved
+#pragma once
+#include <cstddef>
+#include <cstring>
+#include <memory_resource>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace cgf {
+
+  /*========================================================
+   * StringArena
+   *  - copies strings into large blocks taken from a
+   *    monotonic memory resource, and hands out views of the
+   *    copies; storing a string is a bump of a pointer and a
+   *    memcpy, with no allocation per string
+   *  - release() frees every block at once, which ends the
+   *    life of every view it handed out
+   *  - resource() can back std::pmr containers and strings
+   *    that should be freed with the arena, e.g. the buffer
+   *    of an IstreamIterator<std::pmr::string>:
+   *      std::pmr::string buffer(arena.resource());
+   *      auto p = scan(in, buffer, ParseMode::Buffered);
+   */
+  class StringArena {
+  public:
+    explicit
+    StringArena(std::pmr::memory_resource* upstream = std::pmr::get_default_resource())
+      : _resource(blockSize, upstream) {
+    }
+
+    // First fills the caller's buffer, which must outlive the arena
+    StringArena(void* buffer, size_t size, std::pmr::memory_resource* upstream = std::pmr::get_default_resource())
+      : _resource(buffer, size, upstream) {
+    }
+
+    StringArena(StringArena const&) = delete;
+    StringArena& operator =(StringArena const&) = delete;
+
+    std::string_view store(std::string_view text) {
+      if (text.empty()) {
+        return {};
+      }
+      char* copy = static_cast<char*>(_resource.allocate(text.size(), 1));
+      std::memcpy(copy, text.data(), text.size());
+      return { copy, text.size() };
+    }
+
+    std::pmr::memory_resource* resource() {
+      return &_resource;
+    }
+
+    void release() {
+      _resource.release();
+    }
+
+  private:
+    static constexpr size_t blockSize = 64 * 1024;
+
+    std::pmr::monotonic_buffer_resource _resource;
+  };
+
+  /*========================================================
+   * Bulk materialization
+   *  - collect(begin, end, arena) stores every token between
+   *    two iterators in arena, and returns views of them
+   *  - with IstreamIterator<std::string_view> no std::string
+   *    is ever made: each token is copied once, from the
+   *    stream's buffer (or the text) into the arena, while
+   *    its view is still valid
+   *  - the views last until arena.release()
+   */
+
+  template<typename It> inline
+  size_t collect(It begin, It end, StringArena& arena, std::vector<std::string_view>& out) {
+    size_t n = 0;
+    for (; begin != end; ++begin, ++n) {
+      out.push_back(arena.store(std::string_view(*begin)));
+    }
+    return n;
+  }
+
+  template<typename It> inline
+  std::vector<std::string_view> collect(It begin, It end, StringArena& arena) {
+    std::vector<std::string_view> out;
+    collect(std::move(begin), std::move(end), arena, out);
+    return out;
+  }
+
+}
@@ -0,0 +1,348 @@
+// Copyright 2023, Gabriel Foust, All rights reserved
+#pragma once
+#include "input.hpp"
+
+#if defined(CGF_CPP20) && defined(__cpp_impl_coroutine)
+#include <algorithm>
+#include <concepts>
+#include <coroutine>
+#include <cstddef>
+#include <cstring>
+#include <exception>
+#include <istream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace cgf {
+
+  /*========================================================
+   * Asynchronous sources
+   *  - read(buffer, n) reads up to n bytes without blocking,
+   *    returning how many it read, 0 at end of input, or a
+   *    negative number if none are available yet (as a
+   *    non-blocking socket's read fails with EAGAIN); errors
+   *    are thrown
+   *  - readable() returns an awaitable that resumes its
+   *    awaiter once read may have more bytes, typically when
+   *    the event loop reports the socket readable
+   */
+  template<typename S>
+  concept AsyncSource = requires(S& source, char* buffer, size_t n) {
+    { source.read(buffer, n) } -> std::convertible_to<std::ptrdiff_t>;
+    source.readable();
+  };
+
+  /*========================================================
+   * AsyncGenerator
+   *  - the values of a coroutine that co_yields them, pulled
+   *    one at a time by awaiting next(), which returns a
+   *    pointer to the value (valid until the next call), or
+   *    nullptr once the coroutine has returned
+   *  - an exception the coroutine threw is rethrown by next()
+   *  - next() resumes the generator directly, so the stack
+   *    stays flat however many values are read; only when its
+   *    source resumes it does the generator transfer to the
+   *    consumer
+   *  - destroying a generator while it waits on its source
+   *    leaves the source holding a stale handle, so finish
+   *    the scan (or close the source) first
+   */
+  template<typename T>
+  class AsyncGenerator {
+  public:
+    using value_type = T;
+
+    struct promise_type;
+    using Handle = std::coroutine_handle<promise_type>;
+
+    struct promise_type {
+      value_type* current = nullptr;
+      std::coroutine_handle<> consumer;
+      std::exception_ptr error;
+      // whether next() is resuming the generator, and whether
+      // it has since yielded or returned
+      bool resumedByNext = false;
+      bool delivered = false;
+
+      // Hands the value (or the end) to the consumer waiting
+      // in next()
+      struct Transfer {
+        bool await_ready() const noexcept {
+          return false;
+        }
+
+        std::coroutine_handle<> await_suspend(Handle generator) const noexcept {
+          promise_type& promise = generator.promise();
+          promise.delivered = true;
+          return promise.resumedByNext ? std::noop_coroutine() : promise.consumer;
+        }
+
+        void await_resume() const noexcept {
+        }
+      };
+
+      AsyncGenerator get_return_object() noexcept {
+        return AsyncGenerator(Handle::from_promise(*this));
+      }
+
+      std::suspend_always initial_suspend() const noexcept {
+        return {};
+      }
+
+      Transfer final_suspend() noexcept {
+        current = nullptr;
+        return {};
+      }
+
+      Transfer yield_value(value_type& value) noexcept {
+        current = std::addressof(value);
+        return {};
+      }
+
+      void return_void() const noexcept {
+      }
+
+      void unhandled_exception() noexcept {
+        error = std::current_exception();
+      }
+    };
+
+    class Next {
+    public:
+      bool await_ready() const noexcept {
+        return _generator.done();
+      }
+
+      // Stays suspended only if the generator is left waiting
+      // on its source
+      bool await_suspend(std::coroutine_handle<> consumer) const {
+        promise_type& promise = _generator.promise();
+        promise.consumer = consumer;
+        promise.delivered = false;
+        promise.resumedByNext = true;
+        _generator.resume();
+        promise.resumedByNext = false;
+        return !promise.delivered;
+      }
+
+      value_type* await_resume() const {
+        promise_type& promise = _generator.promise();
+        if (promise.error) {
+          std::rethrow_exception(std::exchange(promise.error, nullptr));
+        }
+        return promise.current;
+      }
+
+    private:
+      friend class AsyncGenerator;
+
+      explicit
+      Next(Handle generator) : _generator{ generator } {
+      }
+
+      Handle _generator;
+    };
+
+    AsyncGenerator(AsyncGenerator&& other) noexcept : _handle{ std::exchange(other._handle, nullptr) } {
+    }
+
+    AsyncGenerator& operator =(AsyncGenerator&& other) noexcept {
+      std::swap(_handle, other._handle);
+      return *this;
+    }
+
+    ~AsyncGenerator() {
+      if (_handle) {
+        _handle.destroy();
+      }
+    }
+
+    // Await the next value, e.g.
+    //   while (double* v = co_await values.next()) { ... }
+    Next next() {
+      return Next(_handle);
+    }
+
+  private:
+    explicit
+    AsyncGenerator(Handle handle) : _handle{ handle } {
+    }
+
+    Handle _handle;
+  };
+
+  /*========================================================
+   * Asynchronous scanning
+   *  - the values of a non-blocking source, as an
+   *    AsyncGenerator that suspends while the source has no
+   *    bytes and resumes when readable() does, so one thread
+   *    can parse many sources from an event loop, e.g.
+   *      AsyncGenerator<double> values = scanAsync<double>(socket);
+   *      while (double* v = co_await values.next()) { total += *v; }
+   *  - bytes are buffered, and the complete tokens in the
+   *    buffer (those before its last whitespace) are read as a
+   *    memory source, a block at a time with readInto; a token
+   *    cut off by the end of the bytes read so far waits for
+   *    the rest, and a token longer than the buffer grows it
+   *  - stops where iterating from scan<T>(text) to end would
+   *    (untilEof, untilCount or untilSentinel), or earlier if
+   *    input ends; a failed read throws std::istream::failure
+   *    from next()
+   *  - string_view values point into the buffer, so only last
+   *    until the next call to next()
+   *  - not for records, whose fields may be split between
+   *    reads (scan their fields instead)
+   *  - the source must outlive the generator
+   */
+
+  namespace detail {
+
+    inline constexpr size_t asyncBufferSize = size_t(1) << 16;
+    inline constexpr size_t asyncBlockSize = 256;
+
+    // Just past the last whitespace in [first, last), or first
+    // if there is none
+    inline
+    char const* lastSpace(char const* first, char const* last) {
+      while (last != first && !isSpace(last[-1])) {
+        --last;
+      }
+      return last;
+    }
+
+  }
+
+  template<typename T, AsyncSource Source>
+  AsyncGenerator<T> scanAsync(Source& source, IstreamIterator<T> end = untilEof<T>()) {
+    static_assert(!detail::isFieldRecord<T>, "records cannot be scanned asynchronously");
+    using Count = typename IstreamIterator<T>::Count;
+    using Sentinel = typename IstreamIterator<T>::Sentinel;
+
+    Count const* limit = end.template stopCondition<Count>();
+    Sentinel const* sentinel = end.template stopCondition<Sentinel>();
+    std::vector<char> buffer(detail::asyncBufferSize);
+    std::vector<T> block(detail::asyncBlockSize);
+    // unread bytes are [first, last)
+    size_t first = 0;
+    size_t last = 0;
+    size_t count = 0;
+    bool eof = false;
+    for (;;) {
+      char const* begin = buffer.data() + first;
+      char const* complete = eof ? buffer.data() + last : detail::lastSpace(begin, buffer.data() + last);
+      if (complete != begin) {
+        IstreamIterator<T> p(begin, complete);
+        IstreamIterator<T> stop = limit ? untilCount<T>(limit->value - count)
+                                : sentinel ? IstreamIterator<T>(Sentinel{ sentinel->value })
+                                : untilEof<T>();
+        ReadResult result;
+        do {
+          result = p.readInto(block.data(), block.size(), stop);
+          for (size_t i = 0; i < result.count; ++i) {
+            co_yield block[i];
+          }
+          if (result.reason == StopReason::Failure) {
+            throw std::istream::failure("input failure");
+          }
+        } while (result.reason == StopReason::Full);
+        if (result.reason != StopReason::Eof) {
+          co_return;
+        }
+        count += p.count();
+        first = static_cast<size_t>(complete - buffer.data());
+      }
+      if (eof) {
+        co_return;
+      }
+
+      // keep the cut off token, and grow the buffer if it fills it
+      if (first) {
+        std::memmove(buffer.data(), buffer.data() + first, last - first);
+        last -= first;
+        first = 0;
+      }
+      if (last == buffer.size()) {
+        buffer.resize(2 * buffer.size());
+      }
+      std::ptrdiff_t got;
+      while ((got = source.read(buffer.data() + last, buffer.size() - last)) < 0) {
+        co_await source.readable();
+      }
+      if (got == 0) {
+        eof = true;
+      }
+      last += static_cast<size_t>(got);
+    }
+  }
+
+  /*========================================================
+   * Feed
+   *  - an AsyncSource for event loops that hand over bytes in
+   *    callbacks: push() them as they arrive, and a scan
+   *    waiting for them resumes inside push(), on the loop's
+   *    thread; close() ends input
+   *  - bytes are copied once, into the feed
+   *  - not thread safe: push, close and the scan belong to
+   *    one thread
+   */
+  class Feed {
+  public:
+    void push(std::string_view bytes) {
+      _pending.append(bytes.data(), bytes.size());
+      wake();
+    }
+
+    void close() {
+      _closed = true;
+      wake();
+    }
+
+    std::ptrdiff_t read(char* buffer, size_t n) {
+      if (_next == _pending.size()) {
+        _pending.clear();
+        _next = 0;
+        return _closed ? 0 : -1;
+      }
+      n = std::min(n, _pending.size() - _next);
+      std::memcpy(buffer, _pending.data() + _next, n);
+      _next += n;
+      return static_cast<std::ptrdiff_t>(n);
+    }
+
+    auto readable() {
+      struct Awaiter {
+        Feed* feed;
+
+        bool await_ready() const noexcept {
+          return feed->_closed || feed->_next != feed->_pending.size();
+        }
+
+        void await_suspend(std::coroutine_handle<> reader) const noexcept {
+          feed->_waiting = reader;
+        }
+
+        void await_resume() const noexcept {
+        }
+      };
+      return Awaiter{ this };
+    }
+
+  private:
+    void wake() {
+      if (std::coroutine_handle<> reader = std::exchange(_waiting, nullptr)) {
+        reader.resume();
+      }
+    }
+
+    std::string _pending;
+    size_t _next = 0;
+    bool _closed = false;
+    std::coroutine_handle<> _waiting;
+  };
+
+}
+
+#endif
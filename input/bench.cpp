@@ -0,0 +1,767 @@
+// Copyright 2023, Gabriel Foust, All rights reserved
+#include <benchmark/benchmark.h>
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <istream>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <random>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "arena.hpp"
+#include "async.hpp"
+#include "checked.hpp"
+#include "columns.hpp"
+#include "compressed.hpp"
+#include "index.hpp"
+#include "input.hpp"
+#include "output.hpp"
+#include "ranges.hpp"
+#include "reduce.hpp"
+#include "stop.hpp"
+
+/*========================================================
+ * Throughput benchmarks
+ *  - every benchmark reads the same generated text and
+ *    reports bytes/s and items/s
+ *  - CGF_BENCH_TOKENS sets the number of tokens per dataset
+ *    (default 1M); --benchmark_filter picks benchmarks by
+ *    name, e.g. --benchmark_filter=int/small
+ */
+
+namespace {
+
+  using cgf::ParseMode;
+
+  /*------------------------------------------------------
+   * Datasets
+   *  - each token is drawn from one distribution and
+   *    followed by one to three whitespace characters
+   *  - the last token is a sentinel that never occurs
+   *    elsewhere ("-1" for numbers, "#end" for words)
+   */
+  enum class Tokens {
+    SmallInt,   // 0 to 99
+    LargeInt,   // 0 to INT_MAX
+    Real,       // doubles over several magnitudes
+    Word,       // 1 to 12 lowercase letters
+  };
+
+  char const* name(Tokens kind) {
+    switch (kind) {
+    case Tokens::SmallInt: return "small";
+    case Tokens::LargeInt: return "large";
+    case Tokens::Real: return "real";
+    case Tokens::Word: return "word";
+    }
+    return "";
+  }
+
+  size_t tokenCount() {
+    char const* env = std::getenv("CGF_BENCH_TOKENS");
+    size_t n = env ? std::strtoull(env, nullptr, 10) : 0;
+    return n ? n : size_t(1) << 20;
+  }
+
+  std::string const& dataset(Tokens kind) {
+    static std::map<Tokens, std::string> cache;
+    auto found = cache.find(kind);
+    if (found != cache.end()) {
+      return found->second;
+    }
+
+    std::mt19937_64 rng(42);
+    std::string text;
+    char buffer[32];
+    for (size_t i = 0, n = tokenCount(); i < n; ++i) {
+      switch (kind) {
+      case Tokens::SmallInt:
+        text += std::to_string(rng() % 100);
+        break;
+      case Tokens::LargeInt:
+        text += std::to_string(rng() % 2147483648u);
+        break;
+      case Tokens::Real: {
+        double value = std::uniform_real_distribution<double>(0, 1)(rng) * std::pow(10.0, static_cast<int>(rng() % 12) - 4);
+        auto result = std::to_chars(buffer, buffer + sizeof buffer, value);
+        text.append(buffer, result.ptr);
+        break;
+      }
+      case Tokens::Word:
+        for (size_t k = 1 + rng() % 12; k; --k) {
+          text += static_cast<char>('a' + rng() % 26);
+        }
+        break;
+      }
+      text.append(1 + rng() % 3, " \n\t"[rng() % 3]);
+    }
+    text += kind == Tokens::Word ? "#end\n" : "-1\n";
+    return cache.emplace(kind, std::move(text)).first->second;
+  }
+
+  template<typename T>
+  T sentinelValue() {
+    if constexpr (std::is_same_v<T, std::string> || std::is_same_v<T, std::string_view>) {
+      return T("#end");
+    }
+    else {
+      return T(-1);
+    }
+  }
+
+  // Streambuf over existing memory, so no benchmark pays to copy its input
+  struct MemoryBuf : std::streambuf {
+    explicit
+    MemoryBuf(std::string const& text) {
+      char* first = const_cast<char*>(text.data());
+      setg(first, first, first + text.size());
+    }
+  };
+
+  // Streambuf that discards what is written to it
+  struct NullBuf : std::streambuf {
+    int_type overflow(int_type c) override {
+      return traits_type::not_eof(c);
+    }
+
+    std::streamsize xsputn(char const*, std::streamsize n) override {
+      benchmark::ClobberMemory();
+      return n;
+    }
+  };
+
+  enum class Stop {
+    Eof,
+    Count,
+    Sentinel,
+  };
+
+  char const* name(Stop stop) {
+    switch (stop) {
+    case Stop::Eof: return "eof";
+    case Stop::Count: return "count";
+    case Stop::Sentinel: return "sentinel";
+    }
+    return "";
+  }
+
+  // Values read when every benchmark stops at stop
+  size_t expectedCount(Stop stop) {
+    // the sentinel is the last token
+    return stop == Stop::Eof ? tokenCount() + 1 : tokenCount();
+  }
+
+  // Reports throughput, or an error if items is not the
+  // number of values the benchmark should have read
+  void report(benchmark::State& state, std::string const& text, size_t items, size_t expected) {
+    if (items != expected) {
+      state.SkipWithError(("read " + std::to_string(items) + " values, expected " + std::to_string(expected)).c_str());
+      return;
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * text.size()));
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * items));
+  }
+
+  template<typename It>
+  It endFor(It const& begin, Stop stop) {
+    using T = typename It::value_type;
+    switch (stop) {
+    case Stop::Count: return begin.untilCount(tokenCount());
+    case Stop::Sentinel: return begin.untilSentinel(sentinelValue<T>());
+    default: return begin.untilEof();
+    }
+  }
+
+  /*------------------------------------------------------
+   * IstreamIterator over a stream, either parse mode
+   */
+  template<typename T>
+  void scanStream(benchmark::State& state, Tokens kind, Stop stop, ParseMode mode) {
+    std::string const& text = dataset(kind);
+    size_t items = 0;
+    for (auto _ : state) {
+      MemoryBuf buf(text);
+      std::istream in(&buf);
+      auto begin = cgf::scan<T>(in, mode);
+      auto end = endFor(begin, stop);
+      items = 0;
+      for (auto p = begin; p != end; ++p) {
+        benchmark::DoNotOptimize(*p);
+        ++items;
+      }
+    }
+    report(state, text, items, expectedCount(stop));
+  }
+
+  /*------------------------------------------------------
+   * IstreamIterator over memory
+   */
+  template<typename T>
+  void scanMemory(benchmark::State& state, Tokens kind, Stop stop) {
+    std::string const& text = dataset(kind);
+    size_t items = 0;
+    for (auto _ : state) {
+      auto begin = cgf::scan<T>(std::string_view(text));
+      auto end = endFor(begin, stop);
+      items = 0;
+      for (auto p = begin; p != end; ++p) {
+        benchmark::DoNotOptimize(*p);
+        ++items;
+      }
+    }
+    report(state, text, items, expectedCount(stop));
+  }
+
+  /*------------------------------------------------------
+   * StopIterator, with the stopping condition in its type
+   */
+  template<typename T, typename Stop>
+  void scanPolicyWith(benchmark::State& state, std::string const& text, Stop stop, ParseMode mode, size_t expected) {
+    size_t items = 0;
+    for (auto _ : state) {
+      MemoryBuf buf(text);
+      std::istream in(&buf);
+      items = 0;
+      for (auto p = cgf::scan<T>(in, stop, mode); !p.done(); ++p) {
+        benchmark::DoNotOptimize(*p);
+        ++items;
+      }
+    }
+    report(state, text, items, expected);
+  }
+
+  template<typename T>
+  void scanPolicy(benchmark::State& state, Tokens kind, Stop stop, ParseMode mode) {
+    std::string const& text = dataset(kind);
+    switch (stop) {
+    case Stop::Count: return scanPolicyWith<T>(state, text, cgf::stop::Count{ tokenCount() }, mode, expectedCount(stop));
+    case Stop::Sentinel:
+      return scanPolicyWith<T>(state, text, cgf::stop::Sentinel<T>{ sentinelValue<T>() }, mode, expectedCount(stop));
+    default: return scanPolicyWith<T>(state, text, cgf::stop::Eof{}, mode, expectedCount(stop));
+    }
+  }
+
+#if defined(CGF_HAS_ZLIB)
+  /*------------------------------------------------------
+   * IstreamIterator over gzip data in memory, decompressed
+   * on a background thread (bytes/s counts uncompressed text)
+   */
+  std::string const& gzipped(Tokens kind) {
+    static std::map<Tokens, std::string> cache;
+    auto found = cache.find(kind);
+    if (found != cache.end()) {
+      return found->second;
+    }
+
+    std::string const& text = dataset(kind);
+    std::string data(compressBound(static_cast<uLong>(text.size())) + 32, '\0');
+    z_stream stream{};
+    deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY);
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(text.data()));
+    stream.avail_in = static_cast<uInt>(text.size());
+    stream.next_out = reinterpret_cast<Bytef*>(data.data());
+    stream.avail_out = static_cast<uInt>(data.size());
+    deflate(&stream, Z_FINISH);
+    data.resize(stream.total_out);
+    deflateEnd(&stream);
+    return cache.emplace(kind, std::move(data)).first->second;
+  }
+
+  template<typename T>
+  void scanGzip(benchmark::State& state, Tokens kind, ParseMode mode) {
+    std::string const& text = dataset(kind);
+    std::string const& data = gzipped(kind);
+    size_t items = 0;
+    for (auto _ : state) {
+      cgf::DecompressBuf buf(std::string_view(data), cgf::Compression::Gzip);
+      std::istream in(&buf);
+      auto begin = cgf::scan<T>(in, mode);
+      items = 0;
+      for (auto p = begin, end = begin.untilEof(); p != end; ++p) {
+        benchmark::DoNotOptimize(*p);
+        ++items;
+      }
+    }
+    report(state, text, items, tokenCount() + 1);
+  }
+#endif
+
+  /*------------------------------------------------------
+   * Batch reads into a 4K-element block
+   */
+  template<typename T>
+  void scanBatch(benchmark::State& state, Tokens kind, ParseMode mode) {
+    std::string const& text = dataset(kind);
+    std::vector<T> block(4096);
+    size_t items = 0;
+    for (auto _ : state) {
+      MemoryBuf buf(text);
+      std::istream in(&buf);
+      auto begin = cgf::scan<T>(in, mode);
+      items = 0;
+      cgf::ReadResult result;
+      do {
+        result = begin.readInto(block.data(), block.size());
+        benchmark::DoNotOptimize(block.data());
+        items += result.count;
+      } while (result.reason == cgf::StopReason::Full);
+    }
+    report(state, text, items, tokenCount() + 1);
+  }
+
+  /*------------------------------------------------------
+   * Exception-free iteration, checked once at the end
+   */
+  template<typename T>
+  void scanChecked(benchmark::State& state, Tokens kind, ParseMode mode) {
+    std::string const& text = dataset(kind);
+    size_t items = 0;
+    for (auto _ : state) {
+      MemoryBuf buf(text);
+      std::istream in(&buf);
+      cgf::Checked<T> values(cgf::scan<T>(in, mode));
+      for (auto& value : values) {
+        benchmark::DoNotOptimize(value);
+      }
+      if (!values.ok()) {
+        state.SkipWithError("input failure");
+      }
+      items = values.count();
+    }
+    report(state, text, items, tokenCount() + 1);
+  }
+
+  /*------------------------------------------------------
+   * Skipping every token, which only finds token boundaries
+   */
+  template<typename T>
+  void scanSkip(benchmark::State& state, Tokens kind, ParseMode mode) {
+    std::string const& text = dataset(kind);
+    size_t items = 0;
+    for (auto _ : state) {
+      MemoryBuf buf(text);
+      std::istream in(&buf);
+      items = cgf::scan<T>(in, mode).skip(tokenCount() + 1);
+      benchmark::DoNotOptimize(items);
+    }
+    report(state, text, items, tokenCount() + 1);
+  }
+
+  /*------------------------------------------------------
+   * Random access through a checkpoint index, reading one
+   * value at each of a run of random ordinals
+   */
+  template<typename T>
+  void scanIndexed(benchmark::State& state, Tokens kind) {
+    std::string const& text = dataset(kind);
+    cgf::TokenIndex index = cgf::TokenIndex::build(text);
+    std::mt19937_64 rng(7);
+    std::vector<uint64_t> ordinals(1024);
+    for (uint64_t& ordinal : ordinals) {
+      ordinal = rng() % index.tokens();
+    }
+    for (auto _ : state) {
+      for (uint64_t ordinal : ordinals) {
+        benchmark::DoNotOptimize(*cgf::scanAt<T>(text, index, ordinal));
+      }
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * ordinals.size()));
+  }
+
+  /*------------------------------------------------------
+   * Sum by reduction, which parses into blocks
+   */
+  template<typename T>
+  void scanReduce(benchmark::State& state, Tokens kind, ParseMode mode) {
+    std::string const& text = dataset(kind);
+    size_t items = 0;
+    for (auto _ : state) {
+      MemoryBuf buf(text);
+      std::istream in(&buf);
+      cgf::Sum<T> total;
+      items = 0;
+      auto count = [&](T const*, size_t n) { items += n; };
+      cgf::reduce(cgf::scan<T>(in, mode), cgf::untilEof<T>(), total, count);
+      benchmark::DoNotOptimize(total.value());
+    }
+    report(state, text, items, tokenCount() + 1);
+  }
+
+  /*------------------------------------------------------
+   * Keeping every token: views into an arena, or strings
+   */
+  void collectArena(benchmark::State& state, Tokens kind) {
+    std::string const& text = dataset(kind);
+    cgf::StringArena arena;
+    size_t items = 0;
+    for (auto _ : state) {
+      MemoryBuf buf(text);
+      std::istream in(&buf);
+      auto begin = cgf::scan<std::string_view>(in, ParseMode::Buffered);
+      auto tokens = cgf::collect(begin, begin.untilEof(), arena);
+      items = tokens.size();
+      benchmark::DoNotOptimize(tokens.data());
+      arena.release();
+    }
+    report(state, text, items, tokenCount() + 1);
+  }
+
+  void collectStrings(benchmark::State& state, Tokens kind) {
+    std::string const& text = dataset(kind);
+    size_t items = 0;
+    for (auto _ : state) {
+      MemoryBuf buf(text);
+      std::istream in(&buf);
+      auto begin = cgf::scan<std::string>(in, ParseMode::Buffered);
+      std::vector<std::string> tokens(begin, begin.untilEof());
+      items = tokens.size();
+      benchmark::DoNotOptimize(tokens.data());
+    }
+    report(state, text, items, tokenCount() + 1);
+  }
+
+#if defined(CGF_CPP20)
+  /*------------------------------------------------------
+   * C++20 ScanIterator with an eof sentinel
+   */
+  template<typename T>
+  void scanLean(benchmark::State& state, Tokens kind, ParseMode mode) {
+    std::string const& text = dataset(kind);
+    size_t items = 0;
+    for (auto _ : state) {
+      MemoryBuf buf(text);
+      std::istream in(&buf);
+      items = 0;
+      for (auto p = cgf::ranges::scan<T>(in, mode); p != cgf::ranges::untilEof(); ++p) {
+        benchmark::DoNotOptimize(*p);
+        ++items;
+      }
+    }
+    report(state, text, items, tokenCount() + 1);
+  }
+
+  /*------------------------------------------------------
+   * Asynchronous scan of a Feed, pushed packet by packet as
+   * an event loop would
+   */
+  struct Detached {
+    struct promise_type {
+      Detached get_return_object() {
+        return {};
+      }
+      std::suspend_never initial_suspend() {
+        return {};
+      }
+      std::suspend_never final_suspend() noexcept {
+        return {};
+      }
+      void return_void() {
+      }
+      void unhandled_exception() {
+        std::terminate();
+      }
+    };
+  };
+
+  template<typename T>
+  Detached consumeAsync(cgf::AsyncGenerator<T> values, size_t& items) {
+    while (T* value = co_await values.next()) {
+      benchmark::DoNotOptimize(*value);
+      ++items;
+    }
+  }
+
+  template<typename T>
+  void scanAsync(benchmark::State& state, Tokens kind) {
+    std::string const& text = dataset(kind);
+    constexpr size_t packet = 1460;
+    size_t items = 0;
+    for (auto _ : state) {
+      cgf::Feed feed;
+      items = 0;
+      consumeAsync(cgf::scanAsync<T>(feed), items);
+      for (size_t i = 0; i < text.size(); i += packet) {
+        feed.push(std::string_view(text).substr(i, packet));
+      }
+      feed.close();
+    }
+    report(state, text, items, tokenCount() + 1);
+  }
+#endif
+
+  /*------------------------------------------------------
+   * Baselines
+   */
+  template<typename T>
+  void baselineIstreamIterator(benchmark::State& state, Tokens kind) {
+    std::string const& text = dataset(kind);
+    size_t items = 0;
+    for (auto _ : state) {
+      MemoryBuf buf(text);
+      std::istream in(&buf);
+      items = 0;
+      for (std::istream_iterator<T> p(in), end; p != end; ++p) {
+        benchmark::DoNotOptimize(*p);
+        ++items;
+      }
+    }
+    report(state, text, items, tokenCount() + 1);
+  }
+
+  template<typename T>
+  void baselineScanf(benchmark::State& state, Tokens kind) {
+    std::string const& text = dataset(kind);
+    std::FILE* file = std::tmpfile();
+    std::fwrite(text.data(), 1, text.size(), file);
+    size_t items = 0;
+    for (auto _ : state) {
+      std::rewind(file);
+      items = 0;
+      if constexpr (std::is_same_v<T, std::string>) {
+        char value[64];
+        while (std::fscanf(file, "%63s", value) == 1) {
+          benchmark::DoNotOptimize(value);
+          ++items;
+        }
+      }
+      else {
+        T value;
+        while (std::fscanf(file, std::is_same_v<T, int> ? "%d" : "%lf", &value) == 1) {
+          benchmark::DoNotOptimize(value);
+          ++items;
+        }
+      }
+    }
+    std::fclose(file);
+    report(state, text, items, tokenCount() + 1);
+  }
+
+  template<typename T>
+  void baselineFromChars(benchmark::State& state, Tokens kind) {
+    std::string const& text = dataset(kind);
+    size_t items = 0;
+    for (auto _ : state) {
+      char const* p = text.data();
+      char const* last = p + text.size();
+      items = 0;
+      for (;;) {
+        while (p != last && (*p == ' ' || *p == '\n' || *p == '\t')) {
+          ++p;
+        }
+        if (p == last) {
+          break;
+        }
+        T value;
+        auto result = std::from_chars(p, last, value);
+        benchmark::DoNotOptimize(value);
+        p = result.ptr;
+        ++items;
+      }
+    }
+    report(state, text, items, tokenCount() + 1);
+  }
+
+  /*------------------------------------------------------
+   * Records of mixed fields, "id price name" per line
+   */
+  using Trade = std::tuple<int, double, std::string>;
+
+  size_t recordCount() {
+    return tokenCount() / 3;
+  }
+
+  std::string const& records() {
+    static std::string const text = [] {
+      std::mt19937_64 rng(42);
+      std::string text;
+      char buffer[32];
+      for (size_t i = 0, n = recordCount(); i < n; ++i) {
+        text += std::to_string(rng() % 2147483648u);
+        text += ' ';
+        double price = static_cast<double>(rng() % 1000000) / 100;
+        text.append(buffer, std::to_chars(buffer, buffer + sizeof buffer, price).ptr);
+        text += ' ';
+        for (size_t k = 1 + rng() % 12; k; --k) {
+          text += static_cast<char>('a' + rng() % 26);
+        }
+        text += '\n';
+      }
+      return text;
+    }();
+    return text;
+  }
+
+  void scanRecords(benchmark::State& state, ParseMode mode) {
+    std::string const& text = records();
+    size_t items = 0;
+    for (auto _ : state) {
+      MemoryBuf buf(text);
+      std::istream in(&buf);
+      items = 0;
+      for (auto p = cgf::scan<Trade>(in, mode); p != cgf::untilEof<Trade>(); ++p) {
+        benchmark::DoNotOptimize(*p);
+        ++items;
+      }
+    }
+    report(state, text, items, recordCount());
+  }
+
+  void scanRecordsMemory(benchmark::State& state) {
+    std::string const& text = records();
+    size_t items = 0;
+    for (auto _ : state) {
+      items = 0;
+      for (auto p = cgf::scan<Trade>(text); p != cgf::untilEof<Trade>(); ++p) {
+        benchmark::DoNotOptimize(*p);
+        ++items;
+      }
+    }
+    report(state, text, items, recordCount());
+  }
+
+  void scanRecordColumns(benchmark::State& state) {
+    std::string const& text = records();
+    size_t items = 0;
+    for (auto _ : state) {
+      auto columns = cgf::scanColumns<int, double, std::string>(text);
+      benchmark::DoNotOptimize(columns.column<1>().data());
+      items = columns.size();
+    }
+    report(state, text, items, recordCount());
+  }
+
+  void baselineRecords(benchmark::State& state) {
+    std::string const& text = records();
+    size_t items = 0;
+    for (auto _ : state) {
+      MemoryBuf buf(text);
+      std::istream in(&buf);
+      items = 0;
+      Trade record;
+      while (in >> std::get<0>(record) >> std::get<1>(record) >> std::get<2>(record)) {
+        benchmark::DoNotOptimize(record);
+        ++items;
+      }
+    }
+    report(state, text, items, recordCount());
+  }
+
+  /*------------------------------------------------------
+   * Writing values back out, and a read-write pipeline
+   */
+  template<typename T>
+  void writeBuffered(benchmark::State& state, Tokens kind) {
+    std::string const& text = dataset(kind);
+    std::vector<T> values(cgf::scan<T>(text), cgf::untilEof<T>());
+    for (auto _ : state) {
+      NullBuf buf;
+      std::ostream out(&buf);
+      std::copy(values.begin(), values.end(), cgf::OstreamIterator<T>(out, " "));
+    }
+    report(state, text, values.size(), tokenCount() + 1);
+  }
+
+  template<typename T>
+  void copyBuffered(benchmark::State& state, Tokens kind) {
+    std::string const& text = dataset(kind);
+    size_t items = 0;
+    for (auto _ : state) {
+      NullBuf buf;
+      std::ostream out(&buf);
+      cgf::OstreamIterator<T> sink(out, " ");
+      auto p = cgf::scan<T>(text);
+      for (items = 0; p != cgf::untilEof<T>(); ++p, ++items) {
+        *sink = *p;
+      }
+    }
+    report(state, text, items, tokenCount() + 1);
+  }
+
+  template<typename T>
+  void baselineOstreamIterator(benchmark::State& state, Tokens kind) {
+    std::string const& text = dataset(kind);
+    std::vector<T> values(cgf::scan<T>(text), cgf::untilEof<T>());
+    for (auto _ : state) {
+      NullBuf buf;
+      std::ostream out(&buf);
+      // enough digits to round-trip, as OstreamIterator writes
+      out.precision(std::numeric_limits<double>::max_digits10);
+      std::copy(values.begin(), values.end(), std::ostream_iterator<T>(out, " "));
+    }
+    report(state, text, values.size(), tokenCount() + 1);
+  }
+
+  /*------------------------------------------------------
+   * Registration
+   */
+  template<typename T>
+  void registerType(char const* type, std::initializer_list<Tokens> kinds) {
+    constexpr bool number = !std::is_same_v<T, std::string>;
+    for (Tokens kind : kinds) {
+      std::string prefix = std::string(type) + "/" + name(kind) + "/";
+      for (Stop stop : { Stop::Eof, Stop::Count, Stop::Sentinel }) {
+        benchmark::RegisterBenchmark((prefix + "stream/" + name(stop)).c_str(), scanStream<T>, kind, stop, ParseMode::Stream);
+        benchmark::RegisterBenchmark((prefix + "buffered/" + name(stop)).c_str(), scanStream<T>, kind, stop, ParseMode::Buffered);
+        benchmark::RegisterBenchmark((prefix + "memory/" + name(stop)).c_str(), scanMemory<T>, kind, stop);
+        benchmark::RegisterBenchmark((prefix + "policy/" + name(stop)).c_str(), scanPolicy<T>, kind, stop, ParseMode::Buffered);
+      }
+#if defined(CGF_HAS_ZLIB)
+      benchmark::RegisterBenchmark((prefix + "gzip/buffered").c_str(), scanGzip<T>, kind, ParseMode::Buffered);
+#endif
+      benchmark::RegisterBenchmark((prefix + "skip/buffered").c_str(), scanSkip<T>, kind, ParseMode::Buffered);
+      benchmark::RegisterBenchmark((prefix + "index/seek").c_str(), scanIndexed<T>, kind);
+      benchmark::RegisterBenchmark((prefix + "batch/stream").c_str(), scanBatch<T>, kind, ParseMode::Stream);
+      benchmark::RegisterBenchmark((prefix + "batch/buffered").c_str(), scanBatch<T>, kind, ParseMode::Buffered);
+      benchmark::RegisterBenchmark((prefix + "checked/buffered").c_str(), scanChecked<T>, kind, ParseMode::Buffered);
+#if defined(CGF_CPP20)
+      benchmark::RegisterBenchmark((prefix + "lean/buffered").c_str(), scanLean<T>, kind, ParseMode::Buffered);
+      benchmark::RegisterBenchmark((prefix + "async/feed").c_str(), scanAsync<T>, kind);
+#endif
+      benchmark::RegisterBenchmark((prefix + "baseline/istream_iterator").c_str(), baselineIstreamIterator<T>, kind);
+      benchmark::RegisterBenchmark((prefix + "baseline/scanf").c_str(), baselineScanf<T>, kind);
+      benchmark::RegisterBenchmark((prefix + "write/buffered").c_str(), writeBuffered<T>, kind);
+      benchmark::RegisterBenchmark((prefix + "write/copy").c_str(), copyBuffered<T>, kind);
+      benchmark::RegisterBenchmark((prefix + "baseline/ostream_iterator").c_str(), baselineOstreamIterator<T>, kind);
+      if constexpr (!number) {
+        benchmark::RegisterBenchmark((prefix + "collect/arena").c_str(), collectArena, kind);
+        benchmark::RegisterBenchmark((prefix + "collect/vector").c_str(), collectStrings, kind);
+      }
+      if constexpr (number) {
+        benchmark::RegisterBenchmark((prefix + "reduce/sum").c_str(), scanReduce<T>, kind, ParseMode::Buffered);
+        benchmark::RegisterBenchmark((prefix + "baseline/from_chars").c_str(), baselineFromChars<T>, kind);
+      }
+    }
+  }
+
+}
+
+int main(int argc, char** argv) {
+  registerType<int>("int", { Tokens::SmallInt, Tokens::LargeInt });
+  registerType<double>("double", { Tokens::Real });
+  // float conversion only: operator >>, from_chars through each
+  // source, and from_chars alone
+  benchmark::RegisterBenchmark("float/real/stream/eof", scanStream<float>, Tokens::Real, Stop::Eof, ParseMode::Stream);
+  benchmark::RegisterBenchmark("float/real/buffered/eof", scanStream<float>, Tokens::Real, Stop::Eof, ParseMode::Buffered);
+  benchmark::RegisterBenchmark("float/real/memory/eof", scanMemory<float>, Tokens::Real, Stop::Eof);
+  benchmark::RegisterBenchmark("float/real/baseline/from_chars", baselineFromChars<float>, Tokens::Real);
+  registerType<std::string>("string", { Tokens::Word });
+  benchmark::RegisterBenchmark("record/tuple/stream", scanRecords, ParseMode::Stream);
+  benchmark::RegisterBenchmark("record/tuple/memory", scanRecordsMemory);
+  benchmark::RegisterBenchmark("record/columns/memory", scanRecordColumns);
+  benchmark::RegisterBenchmark("record/baseline/istream", baselineRecords);
+
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+    return 1;
+  }
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+}
@@ -0,0 +1,195 @@
+// Copyright 2023, Gabriel Foust, All rights reserved
+#pragma once
+#include <cstddef>
+#include <exception>
+#include <istream>
+#include <iterator>
+#include <utility>
+#include <vector>
+#include "errors.hpp"
+#include "input.hpp"
+
+namespace cgf {
+
+  /*========================================================
+   * Failure of an exception-free scan
+   */
+  struct ParseError {
+    // where reading stopped, in bytes from the start of the
+    // source; ScanError::unknown if it cannot be told
+    size_t offset;
+
+    // what reading threw, or null if a value did not convert
+    std::exception_ptr exception;
+  };
+
+  /*========================================================
+   * Checked
+   *  - exception-free iteration over [begin, end): values are
+   *    read a block at a time with readInto, and iterators
+   *    walk the block, so dereference, increment and
+   *    comparison are noexcept, never test the stream and do
+   *    no variant dispatch
+   *  - a failure ends iteration as end of input would, and is
+   *    kept until checked, once, after the loop:
+   *      Checked<double> values(scan<double>(in));
+   *      for (double v : values) { total += v; }
+   *      if (!values.ok()) { ... values.error() ... }
+   *  - an exception thrown while reading (by the streambuf,
+   *    or allocating a string) is caught and kept likewise
+   *  - iterate once; values in the block can be moved from
+   *  - string_view values read from a stream only last until
+   *    the next read (see readInto), so use memory sources
+   */
+  template<typename T, typename Stats = NoStats>
+  class Checked {
+  public:
+    using value_type = T;
+
+    static constexpr size_t defaultBlockSize = 1024;
+
+    class iterator {
+    public:
+      using difference_type = ptrdiff_t;
+      using value_type = Checked::value_type;
+      using pointer = value_type*;
+      using reference = value_type&;
+      using iterator_category = std::input_iterator_tag;
+
+      // An end iterator
+      iterator() = default;
+
+      reference operator *() const noexcept {
+        return *_next;
+      }
+
+      pointer operator ->() const noexcept {
+        return _next;
+      }
+
+      iterator& operator ++() noexcept {
+        if (++_next == _last) {
+          _owner->refill(_next, _last);
+        }
+        return *this;
+      }
+
+      void operator ++(int) noexcept {
+        ++*this;
+      }
+
+      // Iterators are equal when both are, or neither is, at
+      // the end
+      bool operator ==(iterator const& rhs) const noexcept {
+        return (_next == _last) == (rhs._next == rhs._last);
+      }
+
+      bool operator !=(iterator const& rhs) const noexcept {
+        return !(*this == rhs);
+      }
+
+    private:
+      friend class Checked;
+
+      iterator(Checked* owner, value_type* next, value_type* last) noexcept
+        : _owner{ owner }, _next{ next }, _last{ last } {
+      }
+
+      Checked* _owner = nullptr;
+      value_type* _next = nullptr;
+      value_type* _last = nullptr;
+    };
+
+    explicit
+    Checked(IstreamIterator<T, Stats> begin, IstreamIterator<T, Stats> end = untilEof<T, Stats>(),
+            size_t blockSize = defaultBlockSize)
+      : _begin{ std::move(begin) }, _end{ std::move(end) }, _block(blockSize ? blockSize : 1) {
+    }
+
+    // Reads the first block
+    iterator begin() noexcept {
+      value_type* next = nullptr;
+      value_type* last = nullptr;
+      refill(next, last);
+      return iterator(this, next, last);
+    }
+
+    iterator end() noexcept {
+      return {};
+    }
+
+    /*------------------------------------------------------
+     * Outcome, once iteration has ended
+     */
+
+    bool ok() const noexcept {
+      return !_failed;
+    }
+
+    // Meaningful only if !ok()
+    ParseError const& error() const noexcept {
+      return _error;
+    }
+
+    // Throws what reading threw, or std::istream::failure if a
+    // value did not convert; does nothing if ok()
+    void rethrow() const {
+      if (_error.exception) {
+        std::rethrow_exception(_error.exception);
+      }
+      if (_failed) {
+        throw std::istream::failure("input failure");
+      }
+    }
+
+    // Values read so far
+    size_t count() const noexcept {
+      return _count;
+    }
+
+  private:
+    void refill(value_type*& next, value_type*& last) noexcept {
+      next = last = _block.data();
+      if (!_more) {
+        return;
+      }
+      try {
+        ReadResult result = _begin.readInto(_block.data(), _block.size(), _end);
+        last += result.count;
+        _count += result.count;
+        _more = result.reason == StopReason::Full;
+        if (result.reason == StopReason::Failure) {
+          fail(nullptr);
+        }
+      }
+      catch (...) {
+        fail(std::current_exception());
+      }
+    }
+
+    void fail(std::exception_ptr exception) noexcept {
+      _more = false;
+      _failed = true;
+      _error.exception = std::move(exception);
+      try {
+        _error.offset = _begin.offset();
+      }
+      catch (...) {
+        _error.offset = ScanError::unknown;
+      }
+    }
+
+    IstreamIterator<T, Stats> _begin;
+    IstreamIterator<T, Stats> _end;
+    std::vector<value_type> _block;
+    size_t _count = 0;
+    bool _more = true;
+    bool _failed = false;
+    ParseError _error{ ScanError::unknown, nullptr };
+  };
+
+#if defined(CGF_CPP20)
+  static_assert(std::input_iterator<Checked<double>::iterator>);
+#endif
+
+}
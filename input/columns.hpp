@@ -0,0 +1,381 @@
+// Copyright 2023, Gabriel Foust, All rights reserved
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <limits>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "input.hpp"
+
+/*========================================================
+ * Arrow C Data Interface
+ *  - the ABI-stable structs from the Arrow specification,
+ *    unless an Arrow header already defined them
+ */
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+
+#define ARROW_FLAG_DICTIONARY_ORDERED 1
+#define ARROW_FLAG_NULLABLE 2
+#define ARROW_FLAG_MAP_KEYS_SORTED 4
+
+struct ArrowSchema {
+  const char* format;
+  const char* name;
+  const char* metadata;
+  int64_t flags;
+  int64_t n_children;
+  struct ArrowSchema** children;
+  struct ArrowSchema* dictionary;
+  void (*release)(struct ArrowSchema*);
+  void* private_data;
+};
+
+struct ArrowArray {
+  int64_t length;
+  int64_t null_count;
+  int64_t offset;
+  int64_t n_buffers;
+  int64_t n_children;
+  const void** buffers;
+  struct ArrowArray** children;
+  struct ArrowArray* dictionary;
+  void (*release)(struct ArrowArray*);
+  void* private_data;
+};
+
+#endif
+
+namespace cgf {
+
+  /*========================================================
+   * Columns
+   *  - records of fields Ts... stored as one contiguous
+   *    vector per field (structure of arrays), so each field
+   *    can be processed with tight, vectorizable loops
+   *  - columns grow together, by at least `growth` rows at a
+   *    time, so appending rarely reallocates
+   */
+  template<typename... Ts>
+  class Columns {
+    static_assert(sizeof...(Ts) > 0, "Columns requires at least one column");
+
+  public:
+    using Row = std::tuple<Ts...>;
+
+    static constexpr size_t growth = size_t(1) << 16;
+
+    size_t size() const {
+      return std::get<0>(_columns).size();
+    }
+
+    bool empty() const {
+      return size() == 0;
+    }
+
+    template<size_t I>
+    auto& column() {
+      return std::get<I>(_columns);
+    }
+
+    template<size_t I>
+    auto const& column() const {
+      return std::get<I>(_columns);
+    }
+
+    std::tuple<std::vector<Ts>...>& columns() {
+      return _columns;
+    }
+
+    void reserve(size_t rows) {
+      std::apply([&](auto&... column) { (column.reserve(rows), ...); }, _columns);
+    }
+
+    // Append n rows, moving their fields
+    void append(Row* rows, size_t n) {
+      size_t capacity = std::get<0>(_columns).capacity();
+      if (size() + n > capacity) {
+        reserve(std::max({ size() + n, size() + growth, 2 * capacity }));
+      }
+      append(rows, n, std::index_sequence_for<Ts...>{});
+    }
+
+  private:
+    template<size_t... I>
+    void append(Row* rows, size_t n, std::index_sequence<I...>) {
+      (appendColumn<I>(rows, n), ...);
+    }
+
+    template<size_t I>
+    void appendColumn(Row* rows, size_t n) {
+      auto& column = std::get<I>(_columns);
+      size_t start = column.size();
+      column.resize(start + n);
+      auto* out = column.data() + start;
+      for (size_t k = 0; k < n; ++k) {
+        out[k] = std::move(std::get<I>(rows[k]));
+      }
+    }
+
+    std::tuple<std::vector<Ts>...> _columns;
+  };
+
+  /*========================================================
+   * Columnar scanning
+   *  - records are read a block at a time with readInto, and
+   *    each block is scattered into the columns while it is
+   *    in cache
+   *  - stops where iterating from begin to end would; a
+   *    failed read throws std::istream::failure
+   */
+
+  namespace detail {
+    inline constexpr size_t columnBlockSize = 4096;
+  }
+
+  template<typename... Ts, typename Stats> inline
+  Columns<Ts...> scanColumns(IstreamIterator<std::tuple<Ts...>, Stats> begin,
+                             IstreamIterator<std::tuple<Ts...>, Stats> const& end) {
+    Columns<Ts...> columns;
+    std::vector<std::tuple<Ts...>> block(detail::columnBlockSize);
+    ReadResult result;
+    do {
+      result = begin.readInto(block.data(), block.size(), end);
+      if (result.reason == StopReason::Failure) {
+        throw std::istream::failure("input failure");
+      }
+      columns.append(block.data(), result.count);
+    } while (result.reason == StopReason::Full);
+    return columns;
+  }
+
+  template<typename... Ts> inline
+  Columns<Ts...> scanColumns(std::string_view text) {
+    return scanColumns(scan<std::tuple<Ts...>>(text), untilEof<std::tuple<Ts...>>());
+  }
+
+  // Records of a delimited source, e.g.
+  // scanColumns<int, double>(text, Dialect::csv())
+  template<typename... Ts> inline
+  Columns<Ts...> scanColumns(std::string_view text, Dialect dialect) {
+    return scanColumns(scan<std::tuple<Ts...>>(text, dialect), untilEof<std::tuple<Ts...>>());
+  }
+
+  template<typename... Ts> inline
+  Columns<Ts...> scanColumns(std::istream& in) {
+    return scanColumns(scan<std::tuple<Ts...>>(in, ParseMode::Buffered), untilEof<std::tuple<Ts...>>());
+  }
+
+  /*========================================================
+   * Arrow export
+   *  - hands columns to an Arrow consumer as a struct array
+   *    with one child per column, through the C Data
+   *    Interface
+   *  - numeric columns are exported zero-copy: the Arrow
+   *    buffers are the vectors' own storage, which the export
+   *    keeps alive until the consumer releases it (each child
+   *    holds a reference, so children can be moved out)
+   *  - string columns are copied once into Arrow's offsets and
+   *    characters layout (utf8, or large utf8 past 2 GiB)
+   *  - names are the children's names, "f0", "f1", ... where
+   *    not given
+   *  - takes the columns by rvalue (std::move them in); on a
+   *    throw, array and schema are left untouched
+   */
+
+  namespace detail {
+
+    template<typename T>
+    inline constexpr bool isArrowString = isString<T> || std::is_same_v<T, std::string_view>;
+
+    template<typename T>
+    constexpr char const* arrowFormat() {
+      static_assert(isArrowString<T> || (std::is_arithmetic_v<T> && !std::is_same_v<T, bool>),
+                    "Arrow export supports numbers and strings");
+      if constexpr (std::is_floating_point_v<T>) {
+        static_assert(sizeof(T) == 4 || sizeof(T) == 8, "Arrow export supports float and double");
+        return sizeof(T) == 4 ? "f" : "g";
+      }
+      else if constexpr (std::is_integral_v<T>) {
+        constexpr bool s = std::is_signed_v<T>;
+        switch (sizeof(T)) {
+        case 1: return s ? "c" : "C";
+        case 2: return s ? "s" : "S";
+        case 4: return s ? "i" : "I";
+        default: return s ? "l" : "L";
+        }
+      }
+      else {
+        return "u";
+      }
+    }
+
+    // Memory behind one exported array (and its children)
+    struct ArrowArrayData {
+      std::shared_ptr<void> owner;
+      std::vector<int32_t> offsets32;
+      std::vector<int64_t> offsets64;
+      std::string chars;
+      void const* buffers[3] = {};
+      std::vector<ArrowArray> children;
+      std::vector<ArrowArray*> childPointers;
+    };
+
+    struct ArrowSchemaData {
+      std::string format;
+      std::string name;
+      std::vector<ArrowSchema> children;
+      std::vector<ArrowSchema*> childPointers;
+    };
+
+    inline
+    void releaseArrowArray(ArrowArray* array) {
+      auto data = static_cast<std::shared_ptr<ArrowArrayData>*>(array->private_data);
+      // children moved out by the consumer have release cleared
+      for (ArrowArray* child : (*data)->childPointers) {
+        if (child->release) {
+          child->release(child);
+        }
+      }
+      delete data;
+      array->release = nullptr;
+    }
+
+    inline
+    void releaseArrowSchema(ArrowSchema* schema) {
+      auto data = static_cast<ArrowSchemaData*>(schema->private_data);
+      for (ArrowSchema* child : data->childPointers) {
+        if (child->release) {
+          child->release(child);
+        }
+      }
+      delete data;
+      schema->release = nullptr;
+    }
+
+    inline
+    void exportArray(ArrowArray& array, std::shared_ptr<ArrowArrayData> const& data, int64_t length, int64_t buffers) {
+      auto holder = new std::shared_ptr<ArrowArrayData>(data);
+      array.length = length;
+      array.null_count = 0;
+      array.offset = 0;
+      array.n_buffers = buffers;
+      array.n_children = static_cast<int64_t>(data->childPointers.size());
+      array.buffers = data->buffers;
+      array.children = data->childPointers.empty() ? nullptr : data->childPointers.data();
+      array.dictionary = nullptr;
+      array.release = releaseArrowArray;
+      array.private_data = holder;
+    }
+
+    inline
+    void exportSchema(ArrowSchema& schema, ArrowSchemaData* data) {
+      schema.format = data->format.c_str();
+      schema.name = data->name.c_str();
+      schema.metadata = nullptr;
+      schema.flags = 0;
+      schema.n_children = static_cast<int64_t>(data->childPointers.size());
+      schema.children = data->childPointers.empty() ? nullptr : data->childPointers.data();
+      schema.dictionary = nullptr;
+      schema.release = releaseArrowSchema;
+      schema.private_data = data;
+    }
+
+    // Export one column as a child array; returns its format
+    template<typename T>
+    std::string exportColumn(ArrowArray& array, std::vector<T> const& column, std::shared_ptr<void> const& owner) {
+      auto data = std::make_shared<ArrowArrayData>();
+      data->owner = owner;
+      std::string format = arrowFormat<T>();
+      if constexpr (isArrowString<T>) {
+        size_t total = 0;
+        for (auto const& value : column) {
+          total += value.size();
+        }
+        data->chars.reserve(total);
+        bool large = total > static_cast<size_t>(std::numeric_limits<int32_t>::max());
+        if (large) {
+          format = "U";
+          data->offsets64.reserve(column.size() + 1);
+          data->offsets64.push_back(0);
+        }
+        else {
+          data->offsets32.reserve(column.size() + 1);
+          data->offsets32.push_back(0);
+        }
+        for (auto const& value : column) {
+          data->chars.append(value.data(), value.size());
+          if (large) {
+            data->offsets64.push_back(static_cast<int64_t>(data->chars.size()));
+          }
+          else {
+            data->offsets32.push_back(static_cast<int32_t>(data->chars.size()));
+          }
+        }
+        data->buffers[1] = large ? static_cast<void const*>(data->offsets64.data()) : data->offsets32.data();
+        data->buffers[2] = data->chars.data();
+        exportArray(array, data, static_cast<int64_t>(column.size()), 3);
+      }
+      else {
+        data->buffers[1] = column.data();
+        exportArray(array, data, static_cast<int64_t>(column.size()), 2);
+      }
+      return format;
+    }
+
+  }
+
+  template<typename... Ts> inline
+  void exportArrow(Columns<Ts...>&& columns, ArrowArray* array, ArrowSchema* schema,
+                   std::vector<std::string> const& names = {}) {
+    constexpr size_t n = sizeof...(Ts);
+    size_t length = columns.size();
+    auto owner = std::make_shared<Columns<Ts...>>(std::move(columns));
+
+    auto arrayData = std::make_shared<detail::ArrowArrayData>();
+    arrayData->children.resize(n);
+    for (ArrowArray& child : arrayData->children) {
+      arrayData->childPointers.push_back(&child);
+    }
+    auto schemaData = std::make_unique<detail::ArrowSchemaData>(detail::ArrowSchemaData{ "+s", "", {}, {} });
+    std::vector<std::unique_ptr<detail::ArrowSchemaData>> childData;
+    try {
+      std::vector<std::string> formats;
+      std::apply([&](auto const&... column) {
+        size_t i = 0;
+        (formats.push_back(detail::exportColumn(arrayData->children[i++], column, owner)), ...);
+      }, owner->columns());
+      schemaData->children.resize(n);
+      for (size_t i = 0; i < n; ++i) {
+        std::string name = i < names.size() ? names[i] : "f" + std::to_string(i);
+        childData.push_back(std::make_unique<detail::ArrowSchemaData>(
+          detail::ArrowSchemaData{ std::move(formats[i]), std::move(name), {}, {} }));
+        schemaData->childPointers.push_back(&schemaData->children[i]);
+      }
+      detail::exportArray(*array, arrayData, static_cast<int64_t>(length), 1);
+    }
+    catch (...) {
+      // release the child arrays already exported
+      for (ArrowArray& child : arrayData->children) {
+        if (child.release) {
+          child.release(&child);
+        }
+      }
+      throw;
+    }
+
+    // nothing below throws, so the schema data is released
+    // only once it is all built
+    for (size_t i = 0; i < n; ++i) {
+      detail::exportSchema(schemaData->children[i], childData[i].release());
+    }
+    detail::exportSchema(*schema, schemaData.release());
+  }
+}
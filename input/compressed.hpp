@@ -0,0 +1,477 @@
+// Copyright 2023, Gabriel Foust, All rights reserved
+#pragma once
+#include <algorithm>
+#include <climits>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <istream>
+#include <memory>
+#include <stdexcept>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "prefetch.hpp"
+
+#if defined(__has_include)
+#if !defined(CGF_NO_ZLIB) && __has_include(<zlib.h>)
+#include <zlib.h>
+#define CGF_HAS_ZLIB
+#endif
+#if !defined(CGF_NO_ZSTD) && __has_include(<zstd.h>)
+#include <zstd.h>
+#define CGF_HAS_ZSTD
+#endif
+#if !defined(CGF_NO_LZ4) && __has_include(<lz4frame.h>)
+#include <lz4frame.h>
+#define CGF_HAS_LZ4
+#endif
+#endif
+
+namespace cgf {
+
+  /*========================================================
+   * Compression formats
+   *  - Auto tells the format by its magic number, and reads
+   *    anything else as uncompressed
+   *  - Gzip also accepts zlib streams; every format accepts
+   *    concatenated members (frames)
+   *  - Gzip ignores zero bytes after the last member (padding
+   *    to a block size); any other trailing bytes are read as
+   *    a member, and so throw as corrupt input
+   *  - a format is compiled in when its library's header is
+   *    found (define CGF_NO_ZLIB, CGF_NO_ZSTD or CGF_NO_LZ4 to
+   *    leave one out), and the program must then link that
+   *    library (z, zstd or lz4); reading a format that is not
+   *    compiled in throws std::runtime_error
+   */
+  enum class Compression : unsigned char {
+    Auto,
+    None,
+    Gzip,
+    Zstd,
+    Lz4,
+  };
+
+  namespace detail {
+
+    /*------------------------------------------------------
+     * Compressed bytes, either read from a streambuf in large
+     * chunks or viewed in place in memory
+     */
+    class CompressedInput {
+    public:
+      CompressedInput(std::streambuf& source, size_t chunkSize)
+        : _source{ &source }, _buffer(std::max<size_t>(64, chunkSize)) {
+        _first = _last = _buffer.data();
+      }
+
+      explicit
+      CompressedInput(std::string_view data) : _first{ data.data() }, _last{ data.data() + data.size() } {
+      }
+
+      char const* data() const {
+        return _first;
+      }
+
+      size_t size() const {
+        return static_cast<size_t>(_last - _first);
+      }
+
+      void consume(size_t n) {
+        _first += n;
+      }
+
+      // Read more, keeping what is not yet consumed; false at
+      // the end of the source
+      bool fill() {
+        if (!_source) {
+          return false;
+        }
+        size_t kept = size();
+        std::memmove(_buffer.data(), _first, kept);
+        std::streamsize got = _source->sgetn(_buffer.data() + kept, static_cast<std::streamsize>(_buffer.size() - kept));
+        _first = _buffer.data();
+        _last = _first + kept + (got > 0 ? static_cast<size_t>(got) : 0);
+        return got > 0;
+      }
+
+      // Copy out uncompressed bytes; 0 at the end of the source
+      size_t read(char* out, size_t n) {
+        size_t done = std::min(n, size());
+        std::memcpy(out, _first, done);
+        consume(done);
+        if (done < n && _source) {
+          std::streamsize got = _source->sgetn(out + done, static_cast<std::streamsize>(n - done));
+          done += got > 0 ? static_cast<size_t>(got) : 0;
+        }
+        return done;
+      }
+
+    private:
+      std::streambuf* _source = nullptr;
+      std::vector<char> _buffer;
+      char const* _first;
+      char const* _last;
+    };
+
+    inline
+    Compression detectCompression(CompressedInput& input) {
+      while (input.size() < 4 && input.fill()) {
+      }
+      auto const* p = reinterpret_cast<unsigned char const*>(input.data());
+      size_t n = input.size();
+      if (n >= 2 && p[0] == 0x1f && p[1] == 0x8b) {
+        return Compression::Gzip;
+      }
+      if (n >= 4 && p[0] == 0x28 && p[1] == 0xb5 && p[2] == 0x2f && p[3] == 0xfd) {
+        return Compression::Zstd;
+      }
+      if (n >= 4 && p[0] == 0x04 && p[1] == 0x22 && p[2] == 0x4d && p[3] == 0x18) {
+        return Compression::Lz4;
+      }
+      return Compression::None;
+    }
+
+    /*------------------------------------------------------
+     * Decoders
+     *  - read(out, n) decompresses up to n bytes into out and
+     *    returns how many it wrote, 0 at the end of the input
+     *  - corrupt or truncated input throws std::runtime_error
+     */
+
+#if defined(CGF_HAS_ZLIB)
+    class GzipDecoder {
+    public:
+      explicit
+      GzipDecoder(CompressedInput& input) : _input{ &input } {
+        // 15 + 32: the largest window, with gzip or zlib headers
+        if (inflateInit2(&_stream, 15 + 32) != Z_OK) {
+          throw std::runtime_error("gzip: cannot initialize decoder");
+        }
+      }
+
+      GzipDecoder(GzipDecoder const&) = delete;
+      GzipDecoder& operator =(GzipDecoder const&) = delete;
+
+      ~GzipDecoder() {
+        inflateEnd(&_stream);
+      }
+
+      size_t read(char* out, size_t n) {
+        size_t done = 0;
+        while (done < n) {
+          bool more = _input->size() || _input->fill();
+          if (_end) {
+            // zero padding after the last member (as tape and
+            // block devices leave) ends the input
+            while (_members && more && skipZeros()) {
+              more = _input->fill();
+            }
+            if (!more) {
+              break;
+            }
+            inflateReset(&_stream);
+            _end = false;
+          }
+          uInt in = static_cast<uInt>(std::min<size_t>(_input->size(), UINT_MAX));
+          uInt room = static_cast<uInt>(std::min<size_t>(n - done, UINT_MAX));
+          _stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(_input->data()));
+          _stream.avail_in = in;
+          _stream.next_out = reinterpret_cast<Bytef*>(out + done);
+          _stream.avail_out = room;
+          int status = inflate(&_stream, Z_NO_FLUSH);
+          _input->consume(in - _stream.avail_in);
+          done += room - _stream.avail_out;
+          if (status == Z_STREAM_END) {
+            _end = true;
+            ++_members;
+          }
+          else if (status == Z_BUF_ERROR && !more) {
+            throw std::runtime_error("gzip: truncated input");
+          }
+          else if (status != Z_OK && status != Z_BUF_ERROR) {
+            throw std::runtime_error(std::string("gzip: ") + (_stream.msg ? _stream.msg : "corrupt input"));
+          }
+        }
+        return done;
+      }
+
+    private:
+      // Consume the zeros the input starts with; true if that
+      // was all of it
+      bool skipZeros() {
+        auto const* p = _input->data();
+        size_t n = _input->size();
+        size_t i = 0;
+        while (i < n && p[i] == 0) {
+          ++i;
+        }
+        _input->consume(i);
+        return i == n;
+      }
+
+      CompressedInput* _input;
+      z_stream _stream{};
+      bool _end = true;     // between members
+      size_t _members = 0;
+    };
+#endif
+
+#if defined(CGF_HAS_ZSTD)
+    class ZstdDecoder {
+    public:
+      explicit
+      ZstdDecoder(CompressedInput& input) : _input{ &input }, _context{ ZSTD_createDCtx() } {
+        if (!_context) {
+          throw std::runtime_error("zstd: cannot initialize decoder");
+        }
+      }
+
+      ZstdDecoder(ZstdDecoder const&) = delete;
+      ZstdDecoder& operator =(ZstdDecoder const&) = delete;
+
+      ~ZstdDecoder() {
+        ZSTD_freeDCtx(_context);
+      }
+
+      size_t read(char* out, size_t n) {
+        size_t done = 0;
+        while (done < n) {
+          bool more = _input->size() || _input->fill();
+          ZSTD_inBuffer in{ _input->data(), _input->size(), 0 };
+          ZSTD_outBuffer room{ out + done, n - done, 0 };
+          size_t status = ZSTD_decompressStream(_context, &room, &in);
+          if (ZSTD_isError(status)) {
+            throw std::runtime_error(std::string("zstd: ") + ZSTD_getErrorName(status));
+          }
+          _input->consume(in.pos);
+          done += room.pos;
+          _end = status == 0;
+          if (!more && room.pos == 0) {
+            if (!_end) {
+              throw std::runtime_error("zstd: truncated input");
+            }
+            break;
+          }
+        }
+        return done;
+      }
+
+    private:
+      CompressedInput* _input;
+      ZSTD_DCtx* _context;
+      bool _end = true;     // between frames
+    };
+#endif
+
+#if defined(CGF_HAS_LZ4)
+    class Lz4Decoder {
+    public:
+      explicit
+      Lz4Decoder(CompressedInput& input) : _input{ &input } {
+        if (LZ4F_isError(LZ4F_createDecompressionContext(&_context, LZ4F_VERSION))) {
+          throw std::runtime_error("lz4: cannot initialize decoder");
+        }
+      }
+
+      Lz4Decoder(Lz4Decoder const&) = delete;
+      Lz4Decoder& operator =(Lz4Decoder const&) = delete;
+
+      ~Lz4Decoder() {
+        LZ4F_freeDecompressionContext(_context);
+      }
+
+      size_t read(char* out, size_t n) {
+        size_t done = 0;
+        while (done < n) {
+          bool more = _input->size() || _input->fill();
+          size_t in = _input->size();
+          size_t room = n - done;
+          size_t status = LZ4F_decompress(_context, out + done, &room, _input->data(), &in, nullptr);
+          if (LZ4F_isError(status)) {
+            throw std::runtime_error(std::string("lz4: ") + LZ4F_getErrorName(status));
+          }
+          _input->consume(in);
+          done += room;
+          _end = status == 0;
+          if (!more && room == 0) {
+            if (!_end) {
+              throw std::runtime_error("lz4: truncated input");
+            }
+            break;
+          }
+        }
+        return done;
+      }
+
+    private:
+      CompressedInput* _input;
+      LZ4F_dctx* _context = nullptr;
+      bool _end = true;     // between frames
+    };
+#endif
+
+    /*------------------------------------------------------
+     * Decoder for any format
+     *  - the format is settled, and its decoder created, by
+     *    the first read, so both happen on the thread that
+     *    reads (and an error surfaces from the read)
+     */
+    class Decoder {
+    public:
+      Decoder(std::streambuf& source, Compression format, size_t chunkSize)
+        : _input(source, chunkSize), _format{ format } {
+      }
+
+      Decoder(std::string_view data, Compression format) : _input(data), _format{ format } {
+      }
+
+      size_t read(char* out, size_t n) {
+        if (!_open) {
+          open();
+        }
+        switch (_format) {
+#if defined(CGF_HAS_ZLIB)
+        case Compression::Gzip: return _gzip->read(out, n);
+#endif
+#if defined(CGF_HAS_ZSTD)
+        case Compression::Zstd: return _zstd->read(out, n);
+#endif
+#if defined(CGF_HAS_LZ4)
+        case Compression::Lz4: return _lz4->read(out, n);
+#endif
+        default: return _input.read(out, n);
+        }
+      }
+
+    private:
+      void open() {
+        _open = true;
+        if (_format == Compression::Auto) {
+          _format = detectCompression(_input);
+        }
+        switch (_format) {
+        case Compression::Gzip:
+#if defined(CGF_HAS_ZLIB)
+          _gzip = std::make_unique<GzipDecoder>(_input);
+          return;
+#else
+          throw std::runtime_error("gzip support is not compiled in");
+#endif
+        case Compression::Zstd:
+#if defined(CGF_HAS_ZSTD)
+          _zstd = std::make_unique<ZstdDecoder>(_input);
+          return;
+#else
+          throw std::runtime_error("zstd support is not compiled in");
+#endif
+        case Compression::Lz4:
+#if defined(CGF_HAS_LZ4)
+          _lz4 = std::make_unique<Lz4Decoder>(_input);
+          return;
+#else
+          throw std::runtime_error("lz4 support is not compiled in");
+#endif
+        default:
+          return;
+        }
+      }
+
+      CompressedInput _input;
+      Compression _format;
+      bool _open = false;
+#if defined(CGF_HAS_ZLIB)
+      std::unique_ptr<GzipDecoder> _gzip;
+#endif
+#if defined(CGF_HAS_ZSTD)
+      std::unique_ptr<ZstdDecoder> _zstd;
+#endif
+#if defined(CGF_HAS_LZ4)
+      std::unique_ptr<Lz4Decoder> _lz4;
+#endif
+    };
+
+    inline
+    PrefetchBuf::Fill decodeInto(std::shared_ptr<Decoder> decoder) {
+      return [decoder](char* block, size_t size) {
+        return decoder->read(block, size);
+      };
+    }
+
+  }
+
+  /*========================================================
+   * DecompressBuf
+   *  - a PrefetchBuf whose background thread decompresses
+   *    its source, so decompression overlaps with parsing
+   *  - blocks are decompressed straight into the buffers the
+   *    get area points at: with ParseMode::Buffered, tokens
+   *    are parsed in place in the decompressed data, with no
+   *    copy in between
+   *  - the source is a streambuf, or compressed data in
+   *    memory (e.g. MappedFile::view()), which is read in
+   *    place; either must outlive this buffer
+   *  - corrupt or truncated input throws std::runtime_error
+   *    from the read that reaches it
+   */
+  class DecompressBuf : public PrefetchBuf {
+  public:
+    explicit
+    DecompressBuf(std::streambuf& source, Compression format = Compression::Auto,
+                  size_t bufferSize = 1 << 20, size_t bufferCount = 2)
+      : PrefetchBuf(detail::decodeInto(std::make_shared<detail::Decoder>(source, format, bufferSize)),
+                    bufferSize, bufferCount) {
+    }
+
+    explicit
+    DecompressBuf(std::string_view data, Compression format = Compression::Auto,
+                  size_t bufferSize = 1 << 20, size_t bufferCount = 2)
+      : PrefetchBuf(detail::decodeInto(std::make_shared<detail::Decoder>(data, format)),
+                    bufferSize, bufferCount) {
+    }
+  };
+
+  /*========================================================
+   * DecompressStream
+   *  - an istream over a DecompressBuf, for use anywhere an
+   *    std::istream& is accepted, e.g.
+   *      DecompressStream in("values.txt.gz");
+   *      auto p = scan<double>(in, ParseMode::Buffered);
+   *  - either wraps another stream's buffer or opens a file
+   */
+  class DecompressStream : public std::istream {
+  public:
+    explicit
+    DecompressStream(std::istream& source, Compression format = Compression::Auto,
+                     size_t bufferSize = 1 << 20, size_t bufferCount = 2)
+      : std::istream(nullptr),
+        _buf{ std::make_unique<DecompressBuf>(*source.rdbuf(), format, bufferSize, bufferCount) } {
+      rdbuf(_buf.get());
+    }
+
+    explicit
+    DecompressStream(char const* path, Compression format = Compression::Auto,
+                     size_t bufferSize = 1 << 20, size_t bufferCount = 2)
+      : std::istream(nullptr) {
+      if (_file.open(path, std::ios_base::in | std::ios_base::binary)) {
+        _buf = std::make_unique<DecompressBuf>(_file, format, bufferSize, bufferCount);
+        rdbuf(_buf.get());
+      }
+      else {
+        setstate(std::ios_base::failbit);
+      }
+    }
+
+    // The decompression thread stops before the file it reads closes
+    ~DecompressStream() override {
+      _buf.reset();
+    }
+
+  private:
+    std::filebuf _file;
+    std::unique_ptr<DecompressBuf> _buf;
+  };
+
+}
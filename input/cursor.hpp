@@ -0,0 +1,300 @@
+// Copyright 2023, Gabriel Foust, All rights reserved
+#pragma once
+#include <cstddef>
+#include <istream>
+#include <iterator>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include "delimited.hpp"
+#include "errors.hpp"
+#include "parse.hpp"
+#include "state.hpp"
+#include "stats.hpp"
+
+#if defined(CGF_CPP20)
+#include <ranges>
+#endif
+
+namespace cgf {
+
+  /*========================================================
+   * Cursor
+   *  - one position in a source, shared by every iterator
+   *    into it: the source, the lookahead value and the
+   *    count of values read live here, and iterators are
+   *    handles (a pointer) to the cursor
+   *  - segments of the source are read in turn, each picking
+   *    up exactly where the last one stopped, e.g.
+   *      Cursor<int> values(in);
+   *      size_t n = values.next();               // a header count
+   *      for (int v : values.take(n)) { ... }    // n records
+   *      for (int v : values.until(-1)) { ... }  // up to a sentinel
+   *  - a segment ending at a sentinel leaves the sentinel as
+   *    the cursor's next value, so nothing is ever lost or
+   *    read twice; next() or skip() steps over it
+   *  - copying an iterator never copies a value, so all its
+   *    copies see the same next value
+   *  - reads fail (and throw) as IstreamIterator's do
+   *  - a cursor cannot be copied or moved, as iterators point
+   *    at it
+   */
+  template<typename T, typename Stats = NoStats>
+  class Cursor {
+  public:
+    using value_type = std::remove_cv_t<T>;
+
+  private:
+    using InputState = detail::InputState<value_type, Stats>;
+    using MappedState = detail::MappedState<value_type, Stats>;
+    using DelimitedState = detail::DelimitedState<value_type, Stats>;
+
+    // What ends iteration, for an end iterator
+    enum class Stop : unsigned char {
+      None,       // not an end: a handle to the cursor
+      Eof,
+      Count,      // count() reaches limit
+      Sentinel,   // the next value equals sentinel
+    };
+
+  public:
+    /*------------------------------------------------------
+     * Handle iterator
+     *  - an input iterator; postfix ++ returns a proxy holding
+     *    a copy of the value stepped over
+     */
+    class iterator {
+    public:
+      using difference_type = ptrdiff_t;
+      using value_type = Cursor::value_type;
+      using pointer = value_type*;
+      using reference = value_type&;
+      using iterator_category = std::input_iterator_tag;
+
+      class Postfix {
+      public:
+        value_type const& operator *() const {
+          return _value;
+        }
+
+      private:
+        friend class iterator;
+
+        explicit
+        Postfix(value_type value) : _value{ std::move(value) } {
+        }
+
+        value_type _value;
+      };
+
+      // An end iterator for end of input
+      iterator() = default;
+
+      reference operator *() const {
+        return _cursor->peek();
+      }
+
+      pointer operator ->() const {
+        return &_cursor->peek();
+      }
+
+      iterator& operator ++() {
+        _cursor->skip();
+        return *this;
+      }
+
+      Postfix operator ++(int) {
+        Postfix old(_cursor->peek());
+        _cursor->skip();
+        return old;
+      }
+
+      bool operator ==(iterator const& rhs) const {
+        if (_stop == Stop::None && rhs._stop == Stop::None) {
+          return _cursor == rhs._cursor;
+        }
+        if (_stop == Stop::None) {
+          return rhs.reached(*_cursor);
+        }
+        if (rhs._stop == Stop::None) {
+          return reached(*rhs._cursor);
+        }
+        return true;
+      }
+
+      bool operator !=(iterator const& rhs) const {
+        return !(*this == rhs);
+      }
+
+    private:
+      friend class Cursor;
+
+      explicit
+      iterator(Cursor* cursor) : _cursor{ cursor }, _stop{ Stop::None } {
+      }
+
+      iterator(Stop stop, size_t limit, value_type sentinel)
+        : _stop{ stop }, _limit{ limit }, _sentinel{ std::move(sentinel) } {
+      }
+
+      // Whether this end iterator's condition holds for cursor
+      bool reached(Cursor& cursor) const {
+        switch (_stop) {
+        case Stop::Count:
+          cursor.recordComparison(false);
+          return cursor.count() >= _limit;
+        case Stop::Sentinel:
+          cursor.recordComparison(true);
+          return detail::matches(cursor.peek(), _sentinel);
+        default:
+          cursor.recordComparison(true);
+          return cursor.done();
+        }
+      }
+
+      Cursor* _cursor = nullptr;
+      Stop _stop = Stop::Eof;
+      size_t _limit = 0;
+      value_type _sentinel{};
+    };
+
+    /*------------------------------------------------------
+     * Segment of the source, as a range
+     */
+    class Segment {
+    public:
+      iterator begin() const {
+        return _begin;
+      }
+
+      iterator end() const {
+        return _end;
+      }
+
+    private:
+      friend class Cursor;
+
+      Segment(iterator begin, iterator end) : _begin{ std::move(begin) }, _end{ std::move(end) } {
+      }
+
+      iterator _begin;
+      iterator _end;
+    };
+
+    /*------------------------------------------------------
+     * Constructors
+     *  - the source (and buffer) must outlive the cursor
+     */
+
+    explicit
+    Cursor(std::istream& in, ParseMode mode = ParseMode::Stream, Stats stats = {}, ErrorSink* errors = nullptr)
+      : _state{ InputState{ stats, &in, false, {}, mode, nullptr, errors } } {
+    }
+
+    // Reads into buffer (see IstreamIterator)
+    Cursor(std::istream& in, value_type& buffer, ParseMode mode = ParseMode::Stream, Stats stats = {},
+           ErrorSink* errors = nullptr)
+      : _state{ InputState{ stats, &in, false, {}, mode, &buffer, errors } } {
+    }
+
+    explicit
+    Cursor(std::string_view text, Stats stats = {}, ErrorSink* errors = nullptr)
+      : _state{ MappedState{ stats, text.data(), text.data(), text.data() + text.size(), false, false, false, {},
+                             nullptr, errors } } {
+    }
+
+    Cursor(std::string_view text, Dialect dialect, Stats stats = {}, ErrorSink* errors = nullptr)
+      : _state{ DelimitedState{ stats, text.data(), text.data(), text.data() + text.size(), false, false, false, true,
+                                {}, nullptr, dialect, errors } } {
+    }
+
+    Cursor(Cursor const&) = delete;
+    Cursor& operator =(Cursor const&) = delete;
+
+    /*------------------------------------------------------
+     * Segments
+     */
+
+    // The next n values (fewer throws, as for untilCount)
+    Segment take(size_t n) {
+      return { begin(), iterator(Stop::Count, _count + n, {}) };
+    }
+
+    // Values up to (not including) the next one equal to sentinel
+    Segment until(value_type sentinel) {
+      static_assert(detail::isEqualityComparable<value_type>, "a sentinel must be comparable with operator ==");
+      return { begin(), iterator(Stop::Sentinel, 0, std::move(sentinel)) };
+    }
+
+    // Values up to end of input
+    Segment rest() {
+      return { begin(), end() };
+    }
+
+    iterator begin() {
+      return iterator(this);
+    }
+
+    iterator end() {
+      return {};
+    }
+
+    /*------------------------------------------------------
+     * Direct access
+     */
+
+    // The next value, read if need be but left unconsumed
+    value_type& peek() {
+      return std::visit([](auto const& state) -> value_type& { return detail::hardCommit(state); }, _state);
+    }
+
+    // Consume the next value and return it
+    value_type next() {
+      value_type value = std::move(peek());
+      skip();
+      return value;
+    }
+
+    // Consume the next value without looking at it
+    void skip() {
+      std::visit([](auto& state) { detail::advance(state); }, _state);
+      ++_count;
+    }
+
+    // Consume up to n values without converting them (see
+    // IstreamIterator::skip); returns the number consumed
+    size_t skip(size_t n) {
+      size_t skipped = std::visit([&](auto const& state) { return detail::skipValues(state, n); }, _state);
+      _count += skipped;
+      return skipped;
+    }
+
+    // True at end of input (reads ahead to know)
+    bool done() {
+      return std::visit([](auto const& state) {
+        detail::softCommit(state);
+        return detail::atEof(state);
+      }, _state);
+    }
+
+    // Values consumed so far
+    size_t count() const {
+      return _count;
+    }
+
+  private:
+    void recordComparison(bool forcesRead) {
+      std::visit([&](auto const& state) { state.recordComparison(forcesRead && !state.valid); }, _state);
+    }
+
+    std::variant<InputState, MappedState, DelimitedState> _state;
+    size_t _count = 0;
+  };
+
+#if defined(CGF_CPP20)
+  static_assert(std::input_iterator<Cursor<double>::iterator>);
+  static_assert(std::ranges::input_range<Cursor<double>::Segment>);
+#endif
+
+}
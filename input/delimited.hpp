@@ -0,0 +1,305 @@
+// Copyright 2023, Gabriel Foust, All rights reserved
+#pragma once
+#include <cstddef>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include "parse.hpp"
+
+namespace cgf {
+
+  /*========================================================
+   * Dialect
+   *  - the separators of a delimited (CSV, TSV, ...) source
+   *  - a quoted field may contain separators; a doubled quote
+   *    inside it stands for one quote character
+   *  - with record '\n', a "\r\n" line ending is accepted too
+   */
+  struct Dialect {
+    char field = ',';
+    char record = '\n';
+    char quote = '"';     // '\0' for no quoting
+
+    static constexpr
+    Dialect csv() {
+      return {};
+    }
+
+    static constexpr
+    Dialect tsv() {
+      return { '\t', '\n', '\0' };
+    }
+  };
+
+  namespace detail {
+
+    /*------------------------------------------------------
+     * Delimiter search
+     *  - first of the field separator, record separator or
+     *    quote (when quoting), using the SIMD kernel
+     */
+    inline
+    char const* findDelimiter(char const* first, char const* last, Dialect const& dialect) {
+      char quote = dialect.quote ? dialect.quote : dialect.field;
+      return first + simd::kernel().findAny(first, static_cast<size_t>(last - first), dialect.field, dialect.record, quote);
+    }
+
+    inline
+    char const* findChar(char const* first, char const* last, char c) {
+      return first + simd::kernel().findAny(first, static_cast<size_t>(last - first), c, c, c);
+    }
+
+    // Separator characters that make up an empty record
+    inline
+    bool isBlank(char c, Dialect const& dialect) {
+      return c == dialect.record || (dialect.record == '\n' && c == '\r');
+    }
+
+    inline
+    std::string_view trimReturn(char const* first, char const* last, Dialect const& dialect) {
+      if (dialect.record == '\n' && last != first && last[-1] == '\r') {
+        --last;
+      }
+      return { first, static_cast<size_t>(last - first) };
+    }
+
+    /*------------------------------------------------------
+     * Split off the field that starts at first
+     *  - returns the separator that ends it, or last
+     *  - text is the field without its quotes; escaped is set
+     *    if it still contains doubled quotes
+     *  - characters between a closing quote and the separator
+     *    are ignored, as is a missing closing quote
+     */
+    inline
+    char const* splitField(char const* first, char const* last, Dialect const& dialect,
+                           std::string_view& text, bool& escaped) {
+      escaped = false;
+      if (dialect.quote && first != last && *first == dialect.quote) {
+        char const* p = first + 1;
+        for (;;) {
+          char const* q = findChar(p, last, dialect.quote);
+          if (q == last) {
+            text = { first + 1, static_cast<size_t>(last - first - 1) };
+            return last;
+          }
+          if (q + 1 != last && q[1] == dialect.quote) {
+            escaped = true;
+            p = q + 2;
+            continue;
+          }
+          text = { first + 1, static_cast<size_t>(q - first - 1) };
+          char const* end = q + 1;
+          while (end != last && *end != dialect.field && *end != dialect.record) {
+            ++end;
+          }
+          return end;
+        }
+      }
+      char const* end = first;
+      while ((end = findDelimiter(end, last, dialect)) != last && *end == dialect.quote) {
+        ++end;
+      }
+      text = trimReturn(first, end, dialect);
+      return end;
+    }
+
+    // Find the record separator that ends the record starting at
+    // first (or last), skipping separators inside quotes
+    inline
+    char const* findRecordEnd(char const* first, char const* last, Dialect const& dialect) {
+      for (;;) {
+        first = findDelimiter(first, last, dialect);
+        if (first == last || *first == dialect.record) {
+          return first;
+        }
+        if (dialect.quote && *first == dialect.quote) {
+          first = findChar(first + 1, last, dialect.quote);
+          if (first == last) {
+            return last;
+          }
+        }
+        ++first;
+      }
+    }
+
+    /*------------------------------------------------------
+     * Convert a field to a value
+     *  - numbers may be padded with whitespace, and integers
+     *    are written in format
+     *  - strings have doubled quotes undone; string_view
+     *    values refer to the field as it appears
+     */
+    template<typename T>
+    bool parseField(std::string_view text, bool escaped, Dialect const& dialect, T& value, NumberFormat format = {}) {
+      if constexpr (isString<T>) {
+        if (escaped) {
+          value.clear();
+          for (size_t i = 0; i < text.size(); ++i) {
+            value.push_back(text[i]);
+            if (text[i] == dialect.quote && i + 1 < text.size() && text[i + 1] == dialect.quote) {
+              ++i;
+            }
+          }
+          return true;
+        }
+        value.assign(text.data(), text.size());
+        return true;
+      }
+      else if constexpr (isNumber<T>) {
+        char const* first = text.data();
+        char const* last = first + text.size();
+        first = skipSpace(first, last);
+        while (last != first && isSpace(last[-1])) {
+          --last;
+        }
+        return parseToken(std::string_view(first, static_cast<size_t>(last - first)), value, format);
+      }
+      else {
+        return parseToken(text, value);
+      }
+    }
+
+  }
+
+  /*========================================================
+   * FieldIterator
+   *  - forward iterator over the fields of one record, as
+   *    views into the record; never allocates
+   *  - escaped() tells whether the current field contains
+   *    doubled quotes, which its view keeps
+   */
+  class FieldIterator {
+  public:
+    using difference_type = ptrdiff_t;
+    using value_type = std::string_view;
+    using pointer = std::string_view const*;
+    using reference = std::string_view const&;
+    using iterator_category = std::forward_iterator_tag;
+
+    FieldIterator() = default;
+
+    FieldIterator(std::string_view record, Dialect dialect)
+      : _next{ record.data() }, _last{ record.data() + record.size() }, _dialect{ dialect }, _done{ false } {
+      split();
+    }
+
+    reference operator *() const {
+      return _field;
+    }
+
+    pointer operator ->() const {
+      return &_field;
+    }
+
+    FieldIterator& operator ++() {
+      if (_next == _last) {
+        _next = nullptr;
+        _done = true;
+      }
+      else {
+        ++_next;
+        split();
+      }
+      return *this;
+    }
+
+    FieldIterator operator ++(int) {
+      FieldIterator copy = *this;
+      ++*this;
+      return copy;
+    }
+
+    bool operator ==(FieldIterator const& rhs) const {
+      return _next == rhs._next && _done == rhs._done;
+    }
+
+    bool operator !=(FieldIterator const& rhs) const {
+      return !(*this == rhs);
+    }
+
+    bool escaped() const {
+      return _escaped;
+    }
+
+  private:
+    void split() {
+      char const* first = _next;
+      _next = detail::splitField(first, _last, _dialect, _field, _escaped);
+    }
+
+    // separator after the current field
+    char const* _next = nullptr;
+    char const* _last = nullptr;
+    Dialect _dialect;
+    std::string_view _field;
+    bool _escaped = false;
+    bool _done = true;
+  };
+
+  /*========================================================
+   * Record
+   *  - one record of a delimited source, as a view of its
+   *    text (without the record separator)
+   *  - records compare equal if their text is the same, so
+   *    one can serve as a sentinel
+   */
+  class Record {
+  public:
+    Record() = default;
+
+    Record(std::string_view text, Dialect dialect = {}) : _text{ text }, _dialect{ dialect } {
+    }
+
+    std::string_view text() const {
+      return _text;
+    }
+
+    Dialect const& dialect() const {
+      return _dialect;
+    }
+
+    FieldIterator begin() const {
+      return FieldIterator(_text, _dialect);
+    }
+
+    FieldIterator end() const {
+      return {};
+    }
+
+    // Number of fields (walks the record)
+    size_t size() const {
+      return static_cast<size_t>(std::distance(begin(), end()));
+    }
+
+    // Field i, which must exist (walks the record)
+    std::string_view operator [](size_t i) const {
+      return *std::next(begin(), static_cast<ptrdiff_t>(i));
+    }
+
+    // Convert field i; false if there is no such field or it
+    // does not convert
+    template<typename T>
+    bool get(size_t i, T& value) const {
+      FieldIterator p = begin();
+      for (; i && p != end(); --i) {
+        ++p;
+      }
+      return p != end() && detail::parseField(*p, p.escaped(), _dialect, value);
+    }
+
+    bool operator ==(Record const& rhs) const {
+      return _text == rhs._text;
+    }
+
+    bool operator !=(Record const& rhs) const {
+      return _text != rhs._text;
+    }
+
+  private:
+    std::string_view _text;
+    Dialect _dialect;
+  };
+
+}
@@ -0,0 +1,76 @@
+// Copyright 2023, Gabriel Foust, All rights reserved
+#pragma once
+#include <cstddef>
+#include <vector>
+
+namespace cgf {
+
+  /*========================================================
+   * Errors skipped by an error-tolerant iterator
+   */
+  enum class ErrorReason : unsigned char {
+    Malformed,    // a token did not convert to the value type
+    Truncated,    // input ended inside a binary record
+  };
+
+  struct ScanError {
+    // offset just past the bad input (where reading resumed),
+    // in bytes from the start of the source; for a stream that
+    // cannot report its position (a pipe), in bytes from where
+    // the iterator started, or unknown if values are read with
+    // operator >> (ParseMode::Stream), which does not count them
+    size_t offset;
+    ErrorReason reason;
+
+    static constexpr size_t unknown = size_t(-1);
+  };
+
+  /*========================================================
+   * ErrorSink
+   *  - collects the errors an iterator skipped, up to a fixed
+   *    capacity; later errors are only counted
+   *  - storage is reserved up front, so recording an error
+   *    never allocates and never throws
+   *  - bind a sink to one source at a time, as offsets are
+   *    relative to the source
+   */
+  class ErrorSink {
+  public:
+    explicit
+    ErrorSink(size_t capacity = 64) : _capacity{ capacity } {
+      _errors.reserve(capacity);
+    }
+
+    void record(size_t offset, ErrorReason reason) noexcept {
+      if (_errors.size() < _capacity) {
+        _errors.push_back({ offset, reason });
+      }
+      ++_count;
+    }
+
+    // The errors recorded, in input order
+    std::vector<ScanError> const& errors() const {
+      return _errors;
+    }
+
+    // Number of errors seen, including those not recorded
+    size_t count() const {
+      return _count;
+    }
+
+    size_t dropped() const {
+      return _count - _errors.size();
+    }
+
+    void clear() {
+      _errors.clear();
+      _count = 0;
+    }
+
+  private:
+    size_t _capacity;
+    size_t _count = 0;
+    std::vector<ScanError> _errors;
+  };
+
+}
@@ -0,0 +1,76 @@
+// Copyright 2023, Gabriel Foust, All rights reserved
+#pragma once
+#include <cstddef>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace cgf {
+
+  /*========================================================
+   * Field records
+   *  - a std::tuple, or a struct that lists its fields, is
+   *    read as one whitespace separated token per field (or,
+   *    from a delimited source, as one record of fields), each
+   *    with its own field type's parser, e.g.
+   *      for (auto [id, price, name] : scan<std::tuple<int, double, std::string>>(text)) { ... }
+   *  - a struct lists its fields by specializing Fields with
+   *    a tuple of member pointers, in the order they are read:
+   *      struct Trade { int id; double price; std::string name; };
+   *      template<> struct cgf::Fields<Trade> {
+   *        static constexpr auto members = std::make_tuple(&Trade::id, &Trade::price, &Trade::name);
+   *      };
+   *  - fields are visited by a fold over the list, so reading
+   *    a record unrolls into one inlined parse per field
+   *  - fields cannot be records themselves; string_view
+   *    fields only last until the next read, and from a
+   *    stream only until the next field is read, so read them
+   *    from memory
+   */
+  template<typename T>
+  struct Fields;
+
+  namespace detail {
+
+    template<typename T>
+    inline constexpr bool isTuple = false;
+
+    template<typename... Ts>
+    inline constexpr bool isTuple<std::tuple<Ts...>> = true;
+
+    template<typename T, typename = void>
+    inline constexpr bool hasFields = false;
+
+    template<typename T>
+    inline constexpr bool hasFields<T, std::void_t<decltype(Fields<T>::members)>> = true;
+
+    template<typename T>
+    inline constexpr bool isFieldRecord = isTuple<T> || hasFields<T>;
+
+    template<typename T>
+    constexpr size_t fieldCount() {
+      if constexpr (isTuple<T>) {
+        return std::tuple_size_v<T>;
+      }
+      else {
+        return std::tuple_size_v<std::remove_cv_t<decltype(Fields<T>::members)>>;
+      }
+    }
+
+    // Apply f to each field of record in order, stopping at the
+    // first for which it returns false; returns whether all
+    // returned true
+    template<typename T, typename F>
+    bool forEachField(T& record, F&& f) {
+      if constexpr (isTuple<T>) {
+        return std::apply([&](auto&... field) { return (f(field) && ...); }, record);
+      }
+      else {
+        return std::apply([&](auto... member) { return (f(record.*member) && ...); }, Fields<T>::members);
+      }
+    }
+
+  }
+
+}
@@ -0,0 +1,261 @@
+// Copyright 2023, Gabriel Foust, All rights reserved
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "input.hpp"
+
+namespace cgf {
+
+  /*========================================================
+   * TokenIndex
+   *  - a sparse index of the whitespace separated tokens of a
+   *    source: a checkpoint (ordinal, offset) every spacing
+   *    tokens, where offset is the byte position just past
+   *    token ordinal - 1, so reading from offset begins with
+   *    token ordinal
+   *  - built in one pass with IstreamIterator::skip, so tokens
+   *    are counted, never converted
+   *  - scanAt gives an iterator positioned at any ordinal by
+   *    seeking to the checkpoint before it and skipping fewer
+   *    than spacing tokens, e.g.
+   *      auto index = TokenIndex::build(file.view());
+   *      index.save("values.txt.idx");
+   *      ...
+   *      auto p = scanAt<double>(file.view(), TokenIndex::load("values.txt.idx"), 1000000);
+   *  - splitChunks(text, index, n) splits at checkpoints into
+   *    chunks of equal token counts, for scanChunks
+   *  - an index only describes the bytes it was built from;
+   *    memory sources are checked by size, streams not at all
+   */
+  struct Checkpoint {
+    uint64_t ordinal;
+    uint64_t offset;
+  };
+
+  class TokenIndex {
+  public:
+    static constexpr size_t defaultSpacing = 4096;
+
+    TokenIndex() = default;
+
+    static
+    TokenIndex build(std::string_view text, size_t spacing = defaultSpacing) {
+      IstreamIterator<std::string_view> p(text.data(), text.data() + text.size());
+      return build(p, spacing);
+    }
+
+    // Offsets are stream positions, so the stream must be
+    // seekable; reads to end of input
+    static
+    TokenIndex build(std::istream& in, size_t spacing = defaultSpacing) {
+      IstreamIterator<std::string_view> p(in, ParseMode::Buffered);
+      if (p.offset() == ScanError::unknown) {
+        throw std::invalid_argument("cannot index a stream that cannot report its position");
+      }
+      return build(p, spacing);
+    }
+
+    /*------------------------------------------------------
+     * Sidecar file
+     *  - a magic number, then spacing, tokens, bytes and the
+     *    checkpoints, all as little-endian 64 bit integers
+     *  - failures throw std::runtime_error
+     */
+
+    void save(std::ostream& out) const {
+      write(out, magic);
+      write(out, _spacing);
+      write(out, _tokens);
+      write(out, _bytes);
+      write(out, _checkpoints.size());
+      for (Checkpoint const& checkpoint : _checkpoints) {
+        write(out, checkpoint.ordinal);
+        write(out, checkpoint.offset);
+      }
+      if (!out) {
+        throw std::runtime_error("cannot write token index");
+      }
+    }
+
+    void save(char const* path) const {
+      std::ofstream out(path, std::ios_base::binary);
+      if (!out) {
+        throw std::runtime_error(std::string("cannot open ") + path);
+      }
+      save(out);
+    }
+
+    static
+    TokenIndex load(std::istream& in) {
+      TokenIndex index;
+      if (read(in) != magic) {
+        throw std::runtime_error("not a token index");
+      }
+      index._spacing = read(in);
+      index._tokens = read(in);
+      index._bytes = read(in);
+      uint64_t size = read(in);
+      if (!in || index._spacing == 0 || size == 0 || size - 1 > index._tokens / index._spacing) {
+        throw std::runtime_error("corrupt token index");
+      }
+      index._checkpoints.resize(size);
+      for (Checkpoint& checkpoint : index._checkpoints) {
+        checkpoint.ordinal = read(in);
+        checkpoint.offset = read(in);
+      }
+      if (!in) {
+        throw std::runtime_error("truncated token index");
+      }
+      return index;
+    }
+
+    static
+    TokenIndex load(char const* path) {
+      std::ifstream in(path, std::ios_base::binary);
+      if (!in) {
+        throw std::runtime_error(std::string("cannot open ") + path);
+      }
+      return load(in);
+    }
+
+    /*------------------------------------------------------
+     * Lookup
+     */
+
+    // The last checkpoint at or before ordinal
+    Checkpoint const& locate(uint64_t ordinal) const {
+      return _checkpoints[std::min<uint64_t>(ordinal / _spacing, _checkpoints.size() - 1)];
+    }
+
+    std::vector<Checkpoint> const& checkpoints() const {
+      return _checkpoints;
+    }
+
+    size_t spacing() const {
+      return _spacing;
+    }
+
+    // Tokens in the source
+    uint64_t tokens() const {
+      return _tokens;
+    }
+
+    // Bytes in the source (for streams, the position of its end)
+    uint64_t bytes() const {
+      return _bytes;
+    }
+
+  private:
+    // "CGFTOKIX"
+    static constexpr uint64_t magic = 0x58494b4f54464743;
+
+    static
+    TokenIndex build(IstreamIterator<std::string_view>& p, size_t spacing) {
+      TokenIndex index;
+      index._spacing = std::max<size_t>(1, spacing);
+      index._checkpoints = { { 0, p.offset() } };
+      while (p.skip(index._spacing) == index._spacing) {
+        index._checkpoints.push_back({ p.count(), p.offset() });
+      }
+      index._tokens = p.count();
+      index._bytes = p.offset();
+      // a checkpoint at the very end has no token to begin
+      if (index._checkpoints.size() > 1 && index._checkpoints.back().ordinal == index._tokens) {
+        index._checkpoints.pop_back();
+      }
+      return index;
+    }
+
+    static
+    void write(std::ostream& out, uint64_t value) {
+      if constexpr (detail::bigEndianHost) {
+        detail::byteSwap(value);
+      }
+      out.write(reinterpret_cast<char const*>(&value), sizeof value);
+    }
+
+    static
+    uint64_t read(std::istream& in) {
+      uint64_t value = 0;
+      in.read(reinterpret_cast<char*>(&value), sizeof value);
+      if constexpr (detail::bigEndianHost) {
+        detail::byteSwap(value);
+      }
+      return value;
+    }
+
+    size_t _spacing = defaultSpacing;
+    uint64_t _tokens = 0;
+    uint64_t _bytes = 0;
+    std::vector<Checkpoint> _checkpoints{ { 0, 0 } };
+  };
+
+  /*========================================================
+   * Random access
+   *  - scanAt returns an iterator whose next value is token
+   *    ordinal (or at end, past the last token); its count()
+   *    is ordinal, so untilCount(m) ends before token m
+   *  - text must be what index was built from, and a stream
+   *    must be seekable (checkpoints are stream positions)
+   */
+
+  template<typename T> inline
+  IstreamIterator<T> scanAt(std::string_view text, TokenIndex const& index, uint64_t ordinal) {
+    if (text.size() != index.bytes()) {
+      throw std::invalid_argument("token index does not match the text");
+    }
+    IstreamIterator<T> p(text.data(), text.data() + text.size());
+    Checkpoint const& checkpoint = index.locate(ordinal);
+    p.seek(checkpoint.offset, checkpoint.ordinal);
+    p.skip(ordinal - checkpoint.ordinal);
+    return p;
+  }
+
+  template<typename T> inline
+  IstreamIterator<T> scanAt(std::istream& in, TokenIndex const& index, uint64_t ordinal,
+                            ParseMode mode = ParseMode::Stream) {
+    IstreamIterator<T> p(in, mode);
+    Checkpoint const& checkpoint = index.locate(ordinal);
+    p.seek(checkpoint.offset, checkpoint.ordinal);
+    if (in.fail()) {
+      throw std::istream::failure("cannot seek to token index checkpoint");
+    }
+    p.skip(ordinal - checkpoint.ordinal);
+    return p;
+  }
+
+  /*========================================================
+   * Chunk boundaries
+   *  - up to n chunks of whole tokens, split at checkpoints so
+   *    each holds about the same number of tokens (however
+   *    their lengths vary), for scanChunks; chunk i begins
+   *    with the token its checkpoint names
+   */
+  inline
+  std::vector<std::string_view> splitChunks(std::string_view text, TokenIndex const& index, size_t n) {
+    if (text.size() != index.bytes()) {
+      throw std::invalid_argument("token index does not match the text");
+    }
+    std::vector<Checkpoint> const& checkpoints = index.checkpoints();
+    n = std::clamp<size_t>(n, 1, checkpoints.size());
+    std::vector<std::string_view> chunks;
+    chunks.reserve(n);
+    size_t begin = 0;
+    for (size_t i = 1; i < n; ++i) {
+      size_t end = static_cast<size_t>(checkpoints[i * checkpoints.size() / n].offset);
+      chunks.push_back(text.substr(begin, end - begin));
+      begin = end;
+    }
+    chunks.push_back(text.substr(begin));
+    return chunks;
+  }
+
+}
@@ -1,19 +1,44 @@
 // Copyright 2023, Gabriel Foust, All rights reserved
 #pragma once
+#include <algorithm>
 #include <cstdint>
 #include <istream>
 #include <iterator>
+#include <string_view>
 #include <type_traits>
 #include <utility>
 #include <variant>
-//#include <concepts>
+#include "delimited.hpp"
+#include "errors.hpp"
+#include "parse.hpp"
+#include "state.hpp"
+#include "stats.hpp"
 
 namespace cgf {
 
+  /*========================================================
+   * Result of a batch read (IstreamIterator::readInto)
+   */
+  enum class StopReason : unsigned char {
+    Full,       // the output was filled
+    Eof,        // input ended
+    Count,      // the count was reached
+    Sentinel,   // the sentinel was read (and left unread)
+    Failure,    // a value could not be read
+  };
+
+  struct ReadResult {
+    size_t count;
+    StopReason reason;
+  };
+
   /*========================================================
    * IstreamIterator
+   *  - Stats is NoStats (the default), which compiles away, or
+   *    CollectStats to record reads, comparisons and timings
+   *    into a ScanStats
    */
-  template<typename T>
+  template<typename T, typename Stats = NoStats>
   class IstreamIterator {
   public:
     /*------------------------------------------------------
@@ -52,10 +77,10 @@ namespace cgf {
       value_type value;
 
       bool operator ==(Sentinel const& rhs) const {
-        return value == rhs.value;
+        return detail::matches(value, rhs.value);
       }
       bool operator !=(Sentinel const& rhs) const {
-        return value != rhs.value;
+        return !detail::matches(value, rhs.value);
       }
     };
 
@@ -64,34 +89,121 @@ namespace cgf {
      * Implementation
      */
 
-    // State of an iterator being used for input
-    struct InputState {
-      std::istream* in;
-      size_t count;
-      mutable bool valid;
-      mutable value_type value;
-    };
+    using InputState = detail::Counted<detail::InputState<value_type, Stats>>;
+    using MappedState = detail::Counted<detail::MappedState<value_type, Stats>>;
+    using DelimitedState = detail::Counted<detail::DelimitedState<value_type, Stats>>;
 
     // Possible object states
-    std::variant<Eof, Count, Sentinel, InputState> _impl;
+    std::variant<Eof, Count, Sentinel, InputState, MappedState, DelimitedState> _impl;
 
-    // Commit to reading the next value
+    // Read up to n values directly into out (see readInto)
+    template<typename State>
     static
-    void softCommit(InputState const& state) {
-      if (!state.valid) {
-        *state.in >> state.value;
+    ReadResult readBatch(State& state, value_type* out, size_t n, IstreamIterator const& end) {
+      auto count = end.template stopCondition<Count>();
+      auto sentinel = end.template stopCondition<Sentinel>();
+      bool eof = end.template stopCondition<Eof>() != nullptr;
+      size_t limit = n;
+      if (count) {
+        if (state.count >= count->value) {
+          return { 0, StopReason::Count };
+        }
+        limit = std::min(n, count->value - state.count);
+      }
+
+      size_t i = 0;
+      if (state.valid && i < limit) {
+        // a comparison already read the next value
+        if (detail::failed(state)) {
+          return { 0, detail::atEof(state) ? StopReason::Eof : StopReason::Failure };
+        }
+        if ((eof && detail::atEof(state)) || (sentinel && detail::matches(detail::slot(state), sentinel->value))) {
+          return { 0, eof ? StopReason::Eof : StopReason::Sentinel };
+        }
+        out[i++] = std::move(detail::slot(state));
+        state.valid = false;
+        ++state.count;
+        state.recordElement();
+      }
+      if constexpr (std::is_same_v<State, InputState>) {
+        // binary records without a sentinel to look for: one
+        // bulk read, which never reads past the limit
+        if (!sentinel && detail::isBinary(state.mode)) {
+          size_t got = detail::fetchRecords(state, out + i, limit - i);
+          for (size_t k = 0; k < got; ++k) {
+            ++state.count;
+            state.recordElement();
+          }
+          i += got;
+          if (i < limit) {
+            return { i, detail::atEof(state) ? StopReason::Eof : StopReason::Failure };
+          }
+          return { i, i == n ? StopReason::Full : StopReason::Count };
+        }
+      }
+      // a memory source of searchable values knows where its
+      // sentinel is, so reads the values before it uncompared
+      char const* before = nullptr;
+      if constexpr (std::is_same_v<State, MappedState> && detail::isSearchable<value_type>) {
+        if (sentinel && i < limit) {
+          before = detail::sentinelBoundary(state, sentinel->value);
+        }
+      }
+      for (; i < limit; ++i) {
+        if constexpr (std::is_same_v<State, MappedState>) {
+          if (before && state.next >= before) {
+            detail::fetch(state, detail::slot(state));
+            state.valid = true;
+            return { i, StopReason::Sentinel };
+          }
+        }
+        detail::fetch(state, out[i]);
+        StopReason reason;
+        if (detail::failed(state)) {
+          reason = detail::atEof(state) ? StopReason::Eof : StopReason::Failure;
+        }
+        else if (eof && detail::atEof(state)) {
+          reason = StopReason::Eof;
+        }
+        else if (sentinel && !before && detail::matches(out[i], sentinel->value)) {
+          reason = StopReason::Sentinel;
+        }
+        else {
+          ++state.count;
+          state.recordElement();
+          continue;
+        }
+        // leave the value behind as the lookahead a comparison
+        // would have left
+        detail::slot(state) = std::move(out[i]);
         state.valid = true;
+        return { i, reason };
       }
+      return { i, i == n ? StopReason::Full : StopReason::Count };
     }
 
-    // Commit to reading the next value and throw exception on failure
-    static
-    reference hardCommit(InputState const& state) {
-      softCommit(state);
-      if (!*state.in) {
-        throw std::istream::failure("input failure");
+    // Apply a function to the active input state
+    //  - throws std::bad_variant_access for stopping conditions
+    template<typename F>
+    decltype(auto) withState(F&& f) const {
+      if (auto state = std::get_if<InputState>(&_impl)) {
+        return f(*state);
+      }
+      if (auto state = std::get_if<DelimitedState>(&_impl)) {
+        return f(*state);
+      }
+      return f(std::get<MappedState>(_impl));
+    }
+
+    template<typename F>
+    decltype(auto) withState(F&& f) {
+      if (auto state = std::get_if<InputState>(&_impl)) {
+        return f(*state);
       }
-      return state.value;
+      if (auto state = std::get_if<DelimitedState>(&_impl)) {
+        return f(*state);
+      }
+      return f(std::get<MappedState>(_impl));
     }
 
     /*------------------------------------------------------
@@ -101,33 +213,56 @@ namespace cgf {
     struct Equivalent {
 
       bool operator ()(InputState const& lhs, InputState const& rhs) {
-        return lhs.in == rhs.in;
+        return detail::sameSource(lhs, rhs);
+      }
+
+      bool operator ()(MappedState const& lhs, MappedState const& rhs) {
+        return detail::sameSource(lhs, rhs);
       }
 
-      bool operator ()(InputState const& lhs, Sentinel const& rhs) {
-        return hardCommit(lhs) == rhs.value;
+      bool operator ()(DelimitedState const& lhs, DelimitedState const& rhs) {
+        return detail::sameSource(lhs, rhs);
+      }
+
+      // a comparison that has to read the next value first is
+      // recorded as forcing that read (a memory source of
+      // strings finds its sentinel by a byte search instead; see
+      // detail::atSentinel)
+
+      template<typename S, std::enable_if_t<detail::isState<S>, int> = 0>
+      bool operator ()(S const& lhs, Sentinel const& rhs) {
+        return detail::atSentinel(lhs, rhs.value);
       }
 
-      bool operator ()(Sentinel const& lhs, InputState const& rhs) {
-        return lhs.value == hardCommit(rhs);
+      template<typename S, std::enable_if_t<detail::isState<S>, int> = 0>
+      bool operator ()(Sentinel const& lhs, S const& rhs) {
+        return detail::atSentinel(rhs, lhs.value);
       }
 
-      bool operator ()(InputState const& lhs, Count rhs) {
+      template<typename S, std::enable_if_t<detail::isState<S>, int> = 0>
+      bool operator ()(S const& lhs, Count rhs) {
+        lhs.recordComparison(false);
         return lhs.count == rhs.value;
       }
 
-      bool operator ()(Count lhs, InputState const& rhs) {
+      template<typename S, std::enable_if_t<detail::isState<S>, int> = 0>
+      bool operator ()(Count lhs, S const& rhs) {
+        rhs.recordComparison(false);
         return lhs.value == rhs.count;
       }
 
-      bool operator ()(InputState const& lhs, Eof) {
-        softCommit(lhs);
-        return lhs.in->eof();
+      template<typename S, std::enable_if_t<detail::isState<S>, int> = 0>
+      bool operator ()(S const& lhs, Eof) {
+        lhs.recordComparison(!lhs.valid);
+        detail::softCommit(lhs);
+        return detail::atEof(lhs);
       }
 
-      bool operator ()(Eof, InputState const& rhs) {
-        softCommit(rhs);
-        return rhs.in->eof();
+      template<typename S, std::enable_if_t<detail::isState<S>, int> = 0>
+      bool operator ()(Eof, S const& rhs) {
+        rhs.recordComparison(!rhs.valid);
+        detail::softCommit(rhs);
+        return detail::atEof(rhs);
       }
 
       template<typename U>
@@ -146,8 +281,42 @@ namespace cgf {
      * Constructors
      */
 
+    //  - format applies to integers read as text
     explicit
-    IstreamIterator(std::istream& in) : _impl{ InputState{ &in, 0, false, {} } } {
+    IstreamIterator(std::istream& in, ParseMode mode = ParseMode::Stream, Stats stats = {}, ErrorSink* errors = nullptr,
+                    NumberFormat format = {})
+      : _impl{ InputState{ { stats, &in, false, {}, mode, nullptr, errors, format } } } {
+    }
+
+    // Reads into buffer, which must outlive the iterator
+    //  - copies share the buffer, so copying and postfix
+    //    increment never copy or move a value
+    IstreamIterator(std::istream& in, value_type& buffer, ParseMode mode = ParseMode::Stream, Stats stats = {},
+                    ErrorSink* errors = nullptr)
+      : _impl{ InputState{ { stats, &in, false, {}, mode, &buffer, errors } } } {
+    }
+
+    // Reads tokens from [first, last), which must outlive the iterator
+    IstreamIterator(char const* first, char const* last, Stats stats = {}, ErrorSink* errors = nullptr,
+                    NumberFormat format = {})
+      : _impl{ MappedState{ { stats, first, first, last, false, false, false, {}, nullptr, errors, format } } } {
+    }
+
+    IstreamIterator(char const* first, char const* last, value_type& buffer, Stats stats = {}, ErrorSink* errors = nullptr)
+      : _impl{ MappedState{ { stats, first, first, last, false, false, false, {}, &buffer, errors } } } {
+    }
+
+    // Reads a delimited source in [first, last): one Record per
+    // record if value_type is Record, else one value per field
+    IstreamIterator(char const* first, char const* last, Dialect dialect, Stats stats = {}, ErrorSink* errors = nullptr,
+                    NumberFormat format = {})
+      : _impl{ DelimitedState{ { stats, first, first, last, false, false, false, true, {}, nullptr, dialect, errors,
+                                 format } } } {
+    }
+
+    IstreamIterator(char const* first, char const* last, Dialect dialect, value_type& buffer, Stats stats = {},
+                    ErrorSink* errors = nullptr)
+      : _impl{ DelimitedState{ { stats, first, first, last, false, false, false, true, {}, &buffer, dialect, errors } } } {
     }
 
     explicit
@@ -167,38 +336,119 @@ namespace cgf {
      */
 
     reference operator *() const {
-      return hardCommit(std::get<InputState>(_impl));
+      return withState([](auto const& state) -> reference { return detail::hardCommit(state); });
     }
 
     pointer operator ->() const {
-      return &hardCommit(std::get<InputState>(_impl));
+      return &**this;
     }
 
     IstreamIterator& operator ++() {
-      auto& state = std::get<InputState>(_impl);
-      hardCommit(state);
-      ++state.count;
-      state.valid = false;
+      withState([](auto& state) {
+        detail::advance(state);
+        ++state.count;
+      });
       return *this;
     }
 
+    // Returns a copy rather than moving from this iterator, so
+    // the value it reads into next keeps its capacity
     IstreamIterator operator ++(int) {
-      auto& state = std::get<InputState>(_impl);
-      hardCommit(state);
-      auto copy = std::move(*this);
-      ++state.count;
-      state.valid = false;
+      withState([](auto& state) { detail::hardCommit(state); });
+      auto copy = *this;
+      ++*this;
       return copy;
     }
 
-    bool operator ==(IstreamIterator const& rhs) {
+    bool operator ==(IstreamIterator const& rhs) const {
       return std::visit(Equivalent{}, _impl, rhs._impl);
     }
 
-    bool operator !=(IstreamIterator const& rhs) {
+    bool operator !=(IstreamIterator const& rhs) const {
       return !std::visit(Equivalent{}, _impl, rhs._impl);
     }
 
+    /*------------------------------------------------------
+     * Skip
+     *  - steps over up to n values, as n increments would (and
+     *    counting toward untilCount), but finds only where the
+     *    tokens end, with the SIMD kernel, instead of converting
+     *    them; see detail::skipValues
+     *  - returns the number skipped; fewer than n means input
+     *    ended (std::advance cannot be specialized, so it still
+     *    increments one value at a time)
+     */
+
+    size_t skip(size_t n) {
+      return withState([&](auto& state) {
+        size_t skipped = detail::skipValues(state, n);
+        state.count += skipped;
+        return skipped;
+      });
+    }
+
+    /*------------------------------------------------------
+     * Position
+     *  - count() is the number of values stepped over, which
+     *    untilCount compares with
+     *  - offset() is where the source stands (see
+     *    detail::offset), past any value a comparison read
+     *  - seek(offset, count) moves the source to offset, as if
+     *    count values had been stepped over to get there; the
+     *    offset should be between tokens (e.g. a TokenIndex
+     *    checkpoint)
+     */
+
+    size_t count() const {
+      return withState([](auto const& state) { return state.count; });
+    }
+
+    size_t offset() const {
+      return withState([](auto const& state) { return detail::offset(state); });
+    }
+
+    void seek(size_t offset, size_t count) {
+      withState([&](auto& state) {
+        detail::seek(state, offset);
+        state.count = count;
+      });
+    }
+
+    /*------------------------------------------------------
+     * Batch read
+     *  - reads up to n values into out, stopping early where
+     *    iterating from *this to end would stop
+     *  - the stopping condition is resolved once, so the loop
+     *    does no per-element variant dispatch
+     *  - a failed read is reported as StopReason::Failure
+     *    rather than thrown; the iterator is left failed, so
+     *    dereferencing it still throws
+     *  - string_view values read from a stream only last until
+     *    the next read, so batch those from memory instead
+     */
+
+    ReadResult readInto(value_type* out, size_t n, IstreamIterator const& end = untilEof()) {
+      if (!end.stopCondition<Eof>() && !end.stopCondition<Count>() && !end.stopCondition<Sentinel>()) {
+        size_t i = 0;
+        for (; i < n && *this != end; ++i, ++*this) {
+          out[i] = **this;
+        }
+        return { i, i == n ? StopReason::Full : StopReason::Eof };
+      }
+      return withState([&](auto& state) { return readBatch(state, out, n, end); });
+    }
+
+    /*------------------------------------------------------
+     * Stopping condition query
+     *  - returns nullptr unless this iterator holds a stopping
+     *    condition of type Condition (Eof, Count or Sentinel)
+     */
+
+    template<typename Condition>
+    Condition const* stopCondition() const {
+      return std::get_if<Condition>(&_impl);
+    }
+
     /*------------------------------------------------------
      * Convenience factory methods
      */
@@ -210,6 +460,7 @@ namespace cgf {
 
     static
     IstreamIterator untilSentinel(value_type value) {
+      static_assert(detail::isEqualityComparable<value_type>, "a sentinel must be comparable with operator ==");
       return IstreamIterator(Sentinel{ std::move(value) });
     }
 
@@ -221,28 +472,118 @@ namespace cgf {
 
   /*========================================================
    * Convenience factory functions
+   *  - a stream is read with operator >> unless a mode is
+   *    given; scan<double>(in, ParseMode::Buffered) is the
+   *    fast, locale independent way to read numbers (see
+   *    ParseMode), and text in memory is always read that way
    */
 
   template<typename T> inline
-  IstreamIterator<T> scan(std::istream& in) {
-    return IstreamIterator<T>(in);
+  IstreamIterator<T> scan(std::istream& in, ParseMode mode = ParseMode::Stream) {
+    return IstreamIterator<T>(in, mode);
   }
 
   template<typename T> inline
-  IstreamIterator<T> untilCount(size_t count) {
-    return IstreamIterator<T>(typename IstreamIterator<T>::Count{ count });
+  IstreamIterator<T> scan(std::istream& in, T& buffer, ParseMode mode = ParseMode::Stream) {
+    return IstreamIterator<T>(in, buffer, mode);
   }
 
   template<typename T> inline
-  IstreamIterator<T> untilSentinel(T value) {
-    return IstreamIterator<T>(typename IstreamIterator<T>::Sentinel{ std::move(value) });
+  IstreamIterator<T> scan(std::string_view text) {
+    return IstreamIterator<T>(text.data(), text.data() + text.size());
   }
 
   template<typename T> inline
-  IstreamIterator<T> untilEof() {
-    return IstreamIterator<T>(typename IstreamIterator<T>::Eof{});
+  IstreamIterator<T> scan(std::string_view text, T& buffer) {
+    return IstreamIterator<T>(text.data(), text.data() + text.size(), buffer);
+  }
+
+  // Fields (or Records) of delimited text, e.g. scan<double>(text, Dialect::csv())
+  template<typename T> inline
+  IstreamIterator<T> scan(std::string_view text, Dialect dialect) {
+    return IstreamIterator<T>(text.data(), text.data() + text.size(), dialect);
+  }
+
+  template<typename T> inline
+  IstreamIterator<T> scan(std::string_view text, Dialect dialect, T& buffer) {
+    return IstreamIterator<T>(text.data(), text.data() + text.size(), dialect, buffer);
+  }
+
+  // Skip bad input, recording it in errors, which must outlive
+  // the iterator (see ErrorSink)
+  template<typename T> inline
+  IstreamIterator<T> scan(std::istream& in, ErrorSink& errors, ParseMode mode = ParseMode::Stream) {
+    return IstreamIterator<T>(in, mode, {}, &errors);
+  }
+
+  template<typename T> inline
+  IstreamIterator<T> scan(std::string_view text, ErrorSink& errors) {
+    return IstreamIterator<T>(text.data(), text.data() + text.size(), {}, &errors);
+  }
+
+  template<typename T> inline
+  IstreamIterator<T> scan(std::string_view text, Dialect dialect, ErrorSink& errors) {
+    return IstreamIterator<T>(text.data(), text.data() + text.size(), dialect, {}, &errors);
+  }
+
+  // Integers written in format, e.g.
+  // scan<uint64_t>(in, NumberFormat::hex(), ParseMode::Buffered)
+  template<typename T> inline
+  IstreamIterator<T> scan(std::istream& in, NumberFormat format, ParseMode mode = ParseMode::Stream) {
+    static_assert(std::is_integral_v<T>, "number formats apply to integral types");
+    return IstreamIterator<T>(in, mode, {}, nullptr, format);
+  }
+
+  template<typename T> inline
+  IstreamIterator<T> scan(std::string_view text, NumberFormat format) {
+    static_assert(std::is_integral_v<T>, "number formats apply to integral types");
+    return IstreamIterator<T>(text.data(), text.data() + text.size(), {}, nullptr, format);
+  }
+
+  template<typename T> inline
+  IstreamIterator<T> scan(std::string_view text, Dialect dialect, NumberFormat format) {
+    static_assert(std::is_integral_v<T>, "number formats apply to integral types");
+    return IstreamIterator<T>(text.data(), text.data() + text.size(), dialect, {}, nullptr, format);
+  }
+
+  // Record statistics into stats, which must outlive the iterator
+  template<typename T> inline
+  IstreamIterator<T, CollectStats> scan(std::istream& in, ScanStats& stats, ParseMode mode = ParseMode::Stream) {
+    return IstreamIterator<T, CollectStats>(in, mode, stats);
+  }
+
+  template<typename T> inline
+  IstreamIterator<T, CollectStats> scan(std::string_view text, ScanStats& stats) {
+    return IstreamIterator<T, CollectStats>(text.data(), text.data() + text.size(), stats);
+  }
+
+  template<typename T, typename Stats> inline
+  ReadResult readInto(IstreamIterator<T, Stats>& begin, IstreamIterator<T, Stats> const& end, T* out, size_t n) {
+    return begin.readInto(out, n, end);
+  }
+
+  // Stopping conditions for an iterator with statistics must
+  // name its Stats policy, e.g. untilEof<int, CollectStats>()
+  template<typename T, typename Stats = NoStats> inline
+  IstreamIterator<T, Stats> untilCount(size_t count) {
+    return IstreamIterator<T, Stats>(typename IstreamIterator<T, Stats>::Count{ count });
+  }
+
+  template<typename T, typename Stats = NoStats> inline
+  IstreamIterator<T, Stats> untilSentinel(T value) {
+    static_assert(detail::isEqualityComparable<T>, "a sentinel must be comparable with operator ==");
+    return IstreamIterator<T, Stats>(typename IstreamIterator<T, Stats>::Sentinel{ std::move(value) });
+  }
+
+  template<typename T, typename Stats = NoStats> inline
+  IstreamIterator<T, Stats> untilEof() {
+    return IstreamIterator<T, Stats>(typename IstreamIterator<T, Stats>::Eof{});
   }
 
-  //static_assert(std::input_iterator<StreamIterator<double>>);
+#if defined(CGF_CPP20)
+  static_assert(std::input_iterator<IstreamIterator<double>>);
+  static_assert(std::sentinel_for<IstreamIterator<double>, IstreamIterator<double>>);
+  static_assert(std::input_iterator<IstreamIterator<double, CollectStats>>);
+#endif
 
 }
\ No newline at end of file
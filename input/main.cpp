@@ -1,6 +1,7 @@
 #include <iostream>
 #include <string>
 #include <vector>
+#include "cursor.hpp"
 #include "input.hpp"
 
 using std::cerr;
@@ -37,18 +38,23 @@ int main() {
     cout << sum1(scan<int>(cin), untilSentinel<int>(-1)) << '\n';
 
 
-    // reusable variable
-    cgf::IstreamIterator<string> instr(cin);
+    // shared cursor: each segment picks up where the last stopped
+    cgf::Cursor<string> words(cin);
 
     // read three strings
-    cout << sum1(instr, instr.untilCount(3)) << '\n';
+    auto three = words.take(3);
+    cout << sum1(three.begin(), three.end()) << '\n';
 
-    // read strings until "a"
-    cout << sum1(instr, instr.untilSentinel("a")) << '\n';
+    // read strings until "a" (which the cursor keeps as its next value)
+    auto beforeA = words.until("a");
+    cout << sum1(beforeA.begin(), beforeA.end()) << '\n';
+    words.skip();
 
 
-    // alternative way to define a variable
-    auto indub = scan<double>(cin);
+    // alternative way to define a variable; Buffered reads
+    // tokens straight from the stream's buffer and converts them
+    // with from_chars, much faster than operator >> for doubles
+    auto indub = scan<double>(cin, cgf::ParseMode::Buffered);
 
     // read doubles until end of file
     cout << sum1(indub, indub.untilEof()) << '\n';
@@ -0,0 +1,266 @@
+// Copyright 2023, Gabriel Foust, All rights reserved
+#pragma once
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+#include "input.hpp"
+
+#if defined(CGF_CPP20)
+#include <span>
+#endif
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace cgf {
+
+  /*========================================================
+   * MappedFile
+   *  - owns a read-only mapping of an entire file
+   *  - the kernel is told the mapping will be read
+   *    sequentially, so it reads ahead aggressively
+   *  - throws std::system_error if the file cannot be mapped
+   */
+  class MappedFile {
+  public:
+    MappedFile() = default;
+
+    explicit
+    MappedFile(char const* path) {
+      open(path);
+    }
+
+    explicit
+    MappedFile(std::string const& path) : MappedFile(path.c_str()) {
+    }
+
+    MappedFile(MappedFile&& other) noexcept
+      : _data{ std::exchange(other._data, nullptr) },
+        _size{ std::exchange(other._size, 0) } {
+    }
+
+    MappedFile& operator =(MappedFile&& other) noexcept {
+      if (this != &other) {
+        close();
+        _data = std::exchange(other._data, nullptr);
+        _size = std::exchange(other._size, 0);
+      }
+      return *this;
+    }
+
+    MappedFile(MappedFile const&) = delete;
+    MappedFile& operator =(MappedFile const&) = delete;
+
+    ~MappedFile() {
+      close();
+    }
+
+    /*------------------------------------------------------
+     * Access
+     */
+
+    char const* data() const {
+      return _data;
+    }
+
+    size_t size() const {
+      return _size;
+    }
+
+    std::string_view view() const {
+      return { _data, _size };
+    }
+
+  private:
+    char const* _data = nullptr;
+    size_t _size = 0;
+
+#if defined(_WIN32)
+    void open(char const* path) {
+      HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+      if (file == INVALID_HANDLE_VALUE) {
+        throw std::system_error(static_cast<int>(GetLastError()), std::system_category(), path);
+      }
+      LARGE_INTEGER size;
+      if (!GetFileSizeEx(file, &size)) {
+        DWORD error = GetLastError();
+        CloseHandle(file);
+        throw std::system_error(static_cast<int>(error), std::system_category(), path);
+      }
+      if (size.QuadPart == 0) {
+        CloseHandle(file);
+        return;
+      }
+      HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+      DWORD error = GetLastError();
+      CloseHandle(file);
+      if (!mapping) {
+        throw std::system_error(static_cast<int>(error), std::system_category(), path);
+      }
+      void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+      error = GetLastError();
+      CloseHandle(mapping);
+      if (!view) {
+        throw std::system_error(static_cast<int>(error), std::system_category(), path);
+      }
+      _data = static_cast<char const*>(view);
+      _size = static_cast<size_t>(size.QuadPart);
+    }
+
+    void close() noexcept {
+      if (_data) {
+        UnmapViewOfFile(_data);
+        _data = nullptr;
+        _size = 0;
+      }
+    }
+#else
+    void open(char const* path) {
+      int fd = ::open(path, O_RDONLY);
+      if (fd < 0) {
+        throw std::system_error(errno, std::generic_category(), path);
+      }
+      struct stat info;
+      if (::fstat(fd, &info) < 0) {
+        int error = errno;
+        ::close(fd);
+        throw std::system_error(error, std::generic_category(), path);
+      }
+      if (info.st_size == 0) {
+        ::close(fd);
+        return;
+      }
+      size_t size = static_cast<size_t>(info.st_size);
+      void* addr = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+      int error = errno;
+      ::close(fd);
+      if (addr == MAP_FAILED) {
+        throw std::system_error(error, std::generic_category(), path);
+      }
+      ::madvise(addr, size, MADV_SEQUENTIAL);
+      _data = static_cast<char const*>(addr);
+      _size = size;
+    }
+
+    void close() noexcept {
+      if (_data) {
+        ::munmap(const_cast<char*>(_data), _size);
+        _data = nullptr;
+        _size = 0;
+      }
+    }
+#endif
+  };
+
+  /*========================================================
+   * Convenience factory functions
+   *  - scan<std::string_view>(file) yields tokens that point
+   *    into the mapping; they stay valid as long as the file
+   */
+
+  template<typename T> inline
+  IstreamIterator<T> scan(MappedFile const& file) {
+    return IstreamIterator<T>(file.data(), file.data() + file.size());
+  }
+
+  template<typename T> inline
+  IstreamIterator<T> scan(MappedFile const& file, Dialect dialect) {
+    return IstreamIterator<T>(file.data(), file.data() + file.size(), dialect);
+  }
+
+  template<typename T>
+  IstreamIterator<T> scan(MappedFile&& file) = delete;
+
+  template<typename T>
+  IstreamIterator<T> scan(MappedFile&& file, Dialect dialect) = delete;
+
+  /*========================================================
+   * Binary records in place
+   *  - records<T>(file) views a file of raw T records (in the
+   *    host's byte order) without copying them; records in
+   *    the other order are read with ParseMode::Binary or
+   *    BinaryBigEndian instead, which swaps them
+   *  - RecordSpan is std::span<T const> in C++20, and a
+   *    minimal stand-in with the same basic interface before
+   *  - throws std::length_error if the file size is not a
+   *    multiple of sizeof(T)
+   */
+
+#if defined(CGF_CPP20)
+  template<typename T>
+  using RecordSpan = std::span<T const>;
+#else
+  template<typename T>
+  class RecordSpan {
+  public:
+    using element_type = T const;
+    using value_type = std::remove_cv_t<T>;
+    using size_type = size_t;
+    using pointer = T const*;
+    using reference = T const&;
+    using iterator = T const*;
+
+    RecordSpan() = default;
+
+    RecordSpan(T const* data, size_t size) : _data{ data }, _size{ size } {
+    }
+
+    pointer data() const {
+      return _data;
+    }
+
+    size_type size() const {
+      return _size;
+    }
+
+    bool empty() const {
+      return _size == 0;
+    }
+
+    iterator begin() const {
+      return _data;
+    }
+
+    iterator end() const {
+      return _data + _size;
+    }
+
+    reference operator [](size_type i) const {
+      return _data[i];
+    }
+
+  private:
+    T const* _data = nullptr;
+    size_t _size = 0;
+  };
+#endif
+
+  // The mapping is page aligned, so any T's alignment is met
+  template<typename T> inline
+  RecordSpan<T> records(MappedFile const& file) {
+    static_assert(std::is_trivially_copyable_v<T>, "records<T> requires a trivially copyable T");
+    if (file.size() % sizeof(T)) {
+      throw std::length_error("file size is not a multiple of the record size");
+    }
+    return RecordSpan<T>(reinterpret_cast<T const*>(file.data()), file.size() / sizeof(T));
+  }
+
+  template<typename T>
+  RecordSpan<T> records(MappedFile&& file) = delete;
+
+}
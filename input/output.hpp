@@ -0,0 +1,389 @@
+// Copyright 2023, Gabriel Foust, All rights reserved
+#pragma once
+#include <algorithm>
+#include <charconv>
+#include <cstddef>
+#include <cstring>
+#include <ios>
+#include <iterator>
+#include <memory>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "fields.hpp"
+#include "parse.hpp"
+
+#if !defined(_WIN32)
+#include <cerrno>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+namespace cgf {
+
+  class Writer;
+
+  namespace detail {
+
+    // Room for any number in shortest form (a long double
+    // needs the most, under 32 characters)
+    inline constexpr size_t maximumNumberLength = 64;
+    inline constexpr size_t minimumCapacity = 256;
+
+    template<typename T>
+    char* formatNumber(char* first, char* last, T value) {
+      auto [ptr, ec] = std::to_chars(first, last, value);
+      if (ec != std::errc()) {
+        throw std::ios_base::failure("cannot format number");
+      }
+      return ptr;
+    }
+
+    // Streambuf that puts characters into a Writer, for types
+    // written with operator <<
+    struct WriterBuf : std::streambuf {
+      explicit
+      WriterBuf(Writer& writer) : writer{ writer } {
+      }
+
+      int_type overflow(int_type c) override;
+      std::streamsize xsputn(char const* s, std::streamsize n) override;
+
+      Writer& writer;
+    };
+
+  }
+
+  /*========================================================
+   * Writer
+   *  - buffered output: values are formatted straight into a
+   *    large buffer, which goes to the sink in one call when
+   *    it fills (one sputn to an ostream's streambuf, or one
+   *    write to a file descriptor)
+   *  - numbers are formatted with to_chars, so doubles are
+   *    written as the shortest text that reads back to the
+   *    same value (scan<double> round-trips them exactly);
+   *    bool and the character types are written as operator
+   *    << writes them, and strings verbatim
+   *  - records (see Fields) are written as their fields
+   *    separated by spaces, so they read back as records
+   *  - other types are written with operator <<
+   *  - a string as large as half the buffer is not copied:
+   *    to a file descriptor it goes out with what is buffered
+   *    in one writev, to a stream in a second sputn
+   *  - a failed write throws std::ios_base::failure (stream)
+   *    or std::system_error (file descriptor)
+   *  - the destructor flushes, but cannot report a failure;
+   *    call flush() to see one
+   */
+  class Writer {
+  public:
+    static constexpr size_t defaultCapacity = size_t(1) << 16;
+
+    explicit
+    Writer(std::ostream& out, size_t capacity = defaultCapacity)
+      : _out{ &out }, _buffer(std::max<size_t>(capacity, detail::minimumCapacity)) {
+    }
+
+#if !defined(_WIN32)
+    // Writes to a file descriptor, which is left open
+    explicit
+    Writer(int fd, size_t capacity = defaultCapacity)
+      : _fd{ fd }, _buffer(std::max<size_t>(capacity, detail::minimumCapacity)) {
+    }
+#endif
+
+    Writer(Writer const&) = delete;
+    Writer& operator =(Writer const&) = delete;
+
+    ~Writer() {
+      try {
+        flush();
+      }
+      catch (...) {
+      }
+    }
+
+    /*------------------------------------------------------
+     * Output
+     */
+
+    template<typename T>
+    void write(T const& value) {
+      using U = std::remove_cv_t<T>;
+      if constexpr (detail::isNumber<U>) {
+        reserve(detail::maximumNumberLength);
+        _size = static_cast<size_t>(detail::formatNumber(_buffer.data() + _size, _buffer.data() + _buffer.size(),
+                                                         value) - _buffer.data());
+      }
+      else if constexpr (std::is_same_v<U, bool>) {
+        put(value ? '1' : '0');
+      }
+      else if constexpr (std::is_same_v<U, char> || std::is_same_v<U, signed char> || std::is_same_v<U, unsigned char>) {
+        put(static_cast<char>(value));
+      }
+      else if constexpr (detail::isString<U> || std::is_same_v<U, std::string_view>) {
+        write(std::string_view(value.data(), value.size()));
+      }
+      else if constexpr (std::is_convertible_v<U, char const*>) {
+        write(std::string_view(value));
+      }
+      else if constexpr (detail::isFieldRecord<U>) {
+        writeFields(value);
+      }
+      else {
+        detail::WriterBuf buf(*this);
+        std::ostream out(&buf);
+        out << value;
+      }
+    }
+
+    void write(std::string_view text) {
+      if (text.size() <= _buffer.size() - _size) {
+        std::memcpy(_buffer.data() + _size, text.data(), text.size());
+        _size += text.size();
+      }
+      else if (text.size() >= _buffer.size() / 2) {
+        writeLarge(text);
+      }
+      else {
+        flushBuffer();
+        std::memcpy(_buffer.data(), text.data(), text.size());
+        _size = text.size();
+      }
+    }
+
+    void put(char c) {
+      reserve(1);
+      _buffer[_size++] = c;
+    }
+
+    // Hand everything buffered to the sink (and flush the stream)
+    void flush() {
+      flushBuffer();
+      if (_out) {
+        _out->flush();
+      }
+    }
+
+    // Bytes handed to the sink so far
+    size_t written() const {
+      return _written;
+    }
+
+  private:
+    // Make room for n bytes
+    void reserve(size_t n) {
+      if (_buffer.size() - _size < n) {
+        flushBuffer();
+      }
+    }
+
+    template<typename T>
+    void writeFields(T const& record) {
+      bool first = true;
+      auto field = [&](auto const& value) {
+        if (!first) {
+          put(' ');
+        }
+        first = false;
+        write(value);
+      };
+      if constexpr (detail::isTuple<T>) {
+        std::apply([&](auto const&... value) { (field(value), ...); }, record);
+      }
+      else {
+        std::apply([&](auto... member) { (field(record.*member), ...); }, Fields<T>::members);
+      }
+    }
+
+    void flushBuffer() {
+      if (_size) {
+        sink(_buffer.data(), _size);
+        _size = 0;
+      }
+    }
+
+    // Write what is buffered and then text, without copying text
+    void writeLarge(std::string_view text) {
+#if !defined(_WIN32)
+      if (!_out) {
+        iovec parts[2] = { { _buffer.data(), _size }, { const_cast<char*>(text.data()), text.size() } };
+        iovec* part = parts[0].iov_len ? parts : parts + 1;
+        int count = part == parts ? 2 : 1;
+        _written += _size + text.size();
+        _size = 0;
+        while (count) {
+          ssize_t n = ::writev(_fd, part, count);
+          if (n < 0) {
+            if (errno == EINTR) {
+              continue;
+            }
+            throw std::system_error(errno, std::generic_category(), "cannot write output");
+          }
+          // step over what was written, which may end mid-part
+          size_t done = static_cast<size_t>(n);
+          while (count && done >= part->iov_len) {
+            done -= part->iov_len;
+            ++part;
+            --count;
+          }
+          if (count) {
+            part->iov_base = static_cast<char*>(part->iov_base) + done;
+            part->iov_len -= done;
+          }
+        }
+        return;
+      }
+#endif
+      flushBuffer();
+      sink(text.data(), text.size());
+    }
+
+    void sink(char const* data, size_t size) {
+      _written += size;
+      if (_out) {
+        if (static_cast<size_t>(_out->rdbuf()->sputn(data, static_cast<std::streamsize>(size))) != size) {
+          _out->setstate(std::ios_base::badbit);
+          throw std::ios_base::failure("cannot write output");
+        }
+        return;
+      }
+#if !defined(_WIN32)
+      while (size) {
+        ssize_t n = ::write(_fd, data, size);
+        if (n < 0) {
+          if (errno == EINTR) {
+            continue;
+          }
+          throw std::system_error(errno, std::generic_category(), "cannot write output");
+        }
+        data += n;
+        size -= static_cast<size_t>(n);
+      }
+#endif
+    }
+
+    std::ostream* _out = nullptr;
+    int _fd = -1;
+    std::vector<char> _buffer;
+    size_t _size = 0;
+    size_t _written = 0;
+  };
+
+  namespace detail {
+
+    inline
+    WriterBuf::int_type WriterBuf::overflow(int_type c) {
+      if (!traits_type::eq_int_type(c, traits_type::eof())) {
+        writer.put(traits_type::to_char_type(c));
+      }
+      return traits_type::not_eof(c);
+    }
+
+    inline
+    std::streamsize WriterBuf::xsputn(char const* s, std::streamsize n) {
+      writer.write(std::string_view(s, static_cast<size_t>(n)));
+      return n;
+    }
+
+    // The writer and separator that copies of an OstreamIterator
+    // share, in one allocation
+    struct SharedWriter {
+      template<typename Sink>
+      SharedWriter(Sink& sink, size_t capacity, std::string_view separator)
+        : writer(sink, capacity), separator{ separator } {
+      }
+
+      Writer writer;
+      std::string separator;
+    };
+
+  }
+
+  /*========================================================
+   * OstreamIterator
+   *  - the output counterpart of IstreamIterator: an output
+   *    iterator that writes each value assigned to it through
+   *    a Writer, followed by separator, e.g.
+   *      std::copy(scan<double>(in, ParseMode::Buffered), untilEof<double>(), OstreamIterator<double>(out, "\n"));
+   *  - copies share one Writer, whose buffer is flushed when
+   *    the last copy is destroyed, or by flush(), and one copy
+   *    of the separator, so copying an iterator (as algorithms
+   *    do freely) does not copy a string
+   *  - unlike std::ostream_iterator, doubles are written in
+   *    full (shortest round-trip form), not with the stream's
+   *    precision
+   */
+  template<typename T>
+  class OstreamIterator {
+  public:
+    using difference_type = ptrdiff_t;
+    using value_type = void;
+    using pointer = void;
+    using reference = void;
+    using iterator_category = std::output_iterator_tag;
+
+    explicit
+    OstreamIterator(std::ostream& out, std::string_view separator = " ",
+                    size_t capacity = Writer::defaultCapacity)
+      : OstreamIterator(std::make_shared<detail::SharedWriter>(out, capacity, separator)) {
+    }
+
+#if !defined(_WIN32)
+    explicit
+    OstreamIterator(int fd, std::string_view separator = " ", size_t capacity = Writer::defaultCapacity)
+      : OstreamIterator(std::make_shared<detail::SharedWriter>(fd, capacity, separator)) {
+    }
+#endif
+
+    // Writes through an existing writer, which, like the text
+    // separator refers to, must outlive the iterator
+    explicit
+    OstreamIterator(Writer& writer, std::string_view separator = " ")
+      : _writer{ std::shared_ptr<Writer>(), &writer }, _separator{ separator } {
+    }
+
+    OstreamIterator& operator =(T const& value) {
+      _writer->write(value);
+      _writer->write(_separator);
+      return *this;
+    }
+
+    OstreamIterator& operator *() {
+      return *this;
+    }
+
+    OstreamIterator& operator ++() {
+      return *this;
+    }
+
+    OstreamIterator& operator ++(int) {
+      return *this;
+    }
+
+    void flush() {
+      _writer->flush();
+    }
+
+    Writer& writer() const {
+      return *_writer;
+    }
+
+  private:
+    explicit
+    OstreamIterator(std::shared_ptr<detail::SharedWriter> const& shared)
+      : _writer{ shared, &shared->writer }, _separator{ shared->separator } {
+    }
+
+    std::shared_ptr<Writer> _writer;
+    std::string_view _separator;
+  };
+
+}
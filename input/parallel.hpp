@@ -0,0 +1,157 @@
+// Copyright 2023, Gabriel Foust, All rights reserved
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <iterator>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "input.hpp"
+#include "mmap.hpp"
+
+namespace cgf {
+
+  /*========================================================
+   * splitChunks
+   *  - divides text into at most n pieces of similar size
+   *  - every boundary falls on whitespace, so no token is
+   *    split between two chunks
+   *  - pieces are never smaller than minSize bytes (except the
+   *    last), so small inputs are not spread over threads
+   */
+  inline
+  std::vector<std::string_view> splitChunks(std::string_view text, size_t n, size_t minSize = 1 << 16) {
+    std::vector<std::string_view> chunks;
+    n = std::max<size_t>(1, std::min(n, text.size() / std::max<size_t>(1, minSize)));
+    char const* first = text.data();
+    char const* last = first + text.size();
+    for (size_t i = 1; i <= n && first != last; ++i) {
+      char const* split = i == n ? last : text.data() + text.size() / n * i;
+      if (split < first) {
+        split = first;
+      }
+      split = detail::findSpace(split, last);
+      chunks.emplace_back(first, static_cast<size_t>(split - first));
+      first = split;
+    }
+    return chunks;
+  }
+
+  /*========================================================
+   * scanChunks
+   *  - parses each chunk on its own thread, with the same
+   *    stopping conditions as a single IstreamIterator:
+   *      untilEof      every token
+   *      untilCount    the first n tokens overall
+   *      untilSentinel tokens before the first sentinel
+   *  - returns one vector per chunk, in order; chunks past the
+   *    stopping point come back empty
+   *  - a parse failure is rethrown (the earliest one, in chunk
+   *    order) as std::istream::failure after all threads end
+   */
+  template<typename T>
+  std::vector<std::vector<T>> scanChunks(std::vector<std::string_view> const& chunks,
+                                         IstreamIterator<T> const& end = untilEof<T>()) {
+    using Iterator = IstreamIterator<T>;
+    auto count = end.template stopCondition<typename Iterator::Count>();
+    auto sentinel = end.template stopCondition<typename Iterator::Sentinel>();
+    size_t limit = count ? count->value : size_t(-1);
+
+    std::vector<std::vector<T>> results(chunks.size());
+    std::vector<std::exception_ptr> errors(chunks.size());
+    std::atomic<size_t> stopChunk{ chunks.size() };
+
+    auto work = [&](size_t i) {
+      try {
+        auto& out = results[i];
+        Iterator eof;
+        for (Iterator p(chunks[i].data(), chunks[i].data() + chunks[i].size());
+             out.size() < limit && p != eof && i < stopChunk.load(std::memory_order_relaxed);
+             ++p) {
+          if (sentinel && *p == sentinel->value) {
+            size_t current = stopChunk.load();
+            while (i < current && !stopChunk.compare_exchange_weak(current, i)) {
+            }
+            break;
+          }
+          out.push_back(std::move(*p));
+        }
+      }
+      catch (...) {
+        errors[i] = std::current_exception();
+      }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(chunks.size());
+    for (size_t i = 1; i < chunks.size(); ++i) {
+      threads.emplace_back(work, i);
+    }
+    if (!chunks.empty()) {
+      work(0);
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+
+    // trim to the stopping point; a failure past it would not
+    // have been reached by a sequential read
+    size_t stop = stopChunk.load();
+    size_t remaining = limit;
+    for (size_t i = 0; i < results.size(); ++i) {
+      auto& chunk = results[i];
+      if (i > stop || remaining == 0) {
+        chunk.clear();
+        continue;
+      }
+      if (chunk.size() >= remaining) {
+        chunk.erase(chunk.begin() + static_cast<ptrdiff_t>(remaining), chunk.end());
+        remaining = 0;
+        continue;
+      }
+      if (errors[i]) {
+        std::rethrow_exception(errors[i]);
+      }
+      remaining -= chunk.size();
+    }
+    return results;
+  }
+
+  template<typename T>
+  std::vector<std::vector<T>> scanChunks(std::string_view text, IstreamIterator<T> const& end = untilEof<T>(),
+                                         unsigned threads = std::thread::hardware_concurrency()) {
+    return scanChunks(splitChunks(text, std::max(1u, threads)), end);
+  }
+
+  /*========================================================
+   * parallelScan
+   *  - as scanChunks, but concatenated into one vector
+   */
+  template<typename T>
+  std::vector<T> parallelScan(std::string_view text, IstreamIterator<T> const& end = untilEof<T>(),
+                              unsigned threads = std::thread::hardware_concurrency()) {
+    auto chunks = scanChunks(text, end, threads);
+    if (chunks.size() == 1) {
+      return std::move(chunks.front());
+    }
+    size_t total = 0;
+    for (auto const& chunk : chunks) {
+      total += chunk.size();
+    }
+    std::vector<T> values;
+    values.reserve(total);
+    for (auto& chunk : chunks) {
+      values.insert(values.end(), std::make_move_iterator(chunk.begin()), std::make_move_iterator(chunk.end()));
+    }
+    return values;
+  }
+
+  template<typename T>
+  std::vector<T> parallelScan(MappedFile const& file, IstreamIterator<T> const& end = untilEof<T>(),
+                              unsigned threads = std::thread::hardware_concurrency()) {
+    return parallelScan(file.view(), end, threads);
+  }
+
+}
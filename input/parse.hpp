@@ -0,0 +1,822 @@
+// Copyright 2023, Gabriel Foust, All rights reserved
+#pragma once
+#include <array>
+#include <charconv>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <limits>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+#include "fields.hpp"
+#include "simd.hpp"
+
+#if __cplusplus >= 202002L || (defined(_MSVC_LANG) && _MSVC_LANG >= 202002L)
+#define CGF_CPP20 1
+#endif
+
+namespace cgf {
+
+  /*========================================================
+   * How an IstreamIterator extracts values from its stream
+   *  - Stream:   operator >> (locale aware, works for any T);
+   *              the default, and the slow way to read numbers
+   *  - Buffered: tokens are cut directly from the streambuf's
+   *              buffer; numbers are converted with from_chars
+   *              (arithmetic T and strings only; other types
+   *              fall back to operator >>); the fast path for
+   *              numbers, reading what operator >> reads in the
+   *              "C" locale, and for doubles several times
+   *              faster (double/real/* in bench.cpp)
+   *  - Binary:   raw little-endian records of a trivially
+   *              copyable T, read with istream::read (open the
+   *              stream in binary mode); a struct's layout and
+   *              padding must be the host's
+   *  - BinaryBigEndian: as Binary, for big-endian records;
+   *              arithmetic and enum T are swapped, and structs
+   *              that list their Fields are swapped field by
+   *              field (other T fail to read when swapped)
+   */
+  enum class ParseMode : unsigned char {
+    Stream,
+    Buffered,
+    Binary,
+    BinaryBigEndian,
+  };
+
+  /*========================================================
+   * NumberFormat
+   *  - how integral values are written in text:
+   *      decimal()     plain decimal (the default)
+   *      hex()         base 16, with an optional 0x prefix
+   *      radix(b)      base 2 to 36, digits then letters in
+   *                    either case
+   *      fixed(n)      decimal with n implied decimal places,
+   *                    e.g. "123.4567" with fixed(4) reads as
+   *                    1234567; at most 19 digits in all
+   *  - fixed point never rounds: a value with more decimal
+   *    places than n (other than trailing zeros) does not
+   *    convert
+   *  - formats apply to integral values read as text; other
+   *    types ignore them
+   */
+  struct NumberFormat {
+    unsigned char base = 10;
+    unsigned char decimals = 0;
+
+    static constexpr
+    NumberFormat decimal() {
+      return {};
+    }
+
+    static constexpr
+    NumberFormat hex() {
+      return { 16, 0 };
+    }
+
+    static constexpr
+    NumberFormat radix(unsigned base) {
+      return { static_cast<unsigned char>(base), 0 };
+    }
+
+    static constexpr
+    NumberFormat fixed(unsigned decimals) {
+      return { 10, static_cast<unsigned char>(decimals) };
+    }
+
+    constexpr
+    bool isDecimal() const {
+      return base == 10 && decimals == 0;
+    }
+  };
+
+  namespace detail {
+
+    /*------------------------------------------------------
+     * Types that have a from_chars parser
+     *  - bool and the character types are excluded because
+     *    operator >> does not read them as numbers
+     */
+    template<typename T>
+    inline constexpr bool isNumber =
+      std::is_arithmetic_v<T>
+      && !std::is_same_v<T, bool>
+      && !std::is_same_v<T, char>
+      && !std::is_same_v<T, signed char>
+      && !std::is_same_v<T, unsigned char>
+      && !std::is_same_v<T, wchar_t>
+      && !std::is_same_v<T, char16_t>
+      && !std::is_same_v<T, char32_t>;
+
+    /*------------------------------------------------------
+     * Binary records
+     */
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    inline constexpr bool bigEndianHost = true;
+#else
+    inline constexpr bool bigEndianHost = false;
+#endif
+
+    inline
+    bool isBinary(ParseMode mode) {
+      return mode == ParseMode::Binary || mode == ParseMode::BinaryBigEndian;
+    }
+
+    // Whether records in this mode are in the opposite byte order
+    inline
+    bool isSwapped(ParseMode mode) {
+      return mode == (bigEndianHost ? ParseMode::Binary : ParseMode::BinaryBigEndian);
+    }
+
+    template<typename T>
+    inline constexpr bool isSwappableScalar = std::is_arithmetic_v<T> || std::is_enum_v<T>;
+
+    template<typename T, typename Members>
+    inline constexpr bool hasSwappableMembers = false;
+
+    template<typename T, typename... Ms>
+    inline constexpr bool hasSwappableMembers<T, std::tuple<Ms T::*...>> = (isSwappableScalar<Ms> && ...);
+
+    template<typename T>
+    constexpr bool isSwappableRecord() {
+      if constexpr (hasFields<T>) {
+        return std::is_trivially_copyable_v<T>
+          && hasSwappableMembers<T, std::remove_cv_t<decltype(Fields<T>::members)>>;
+      }
+      else {
+        return false;
+      }
+    }
+
+    // Whether records of T can be read in the other byte order
+    template<typename T>
+    inline constexpr bool isSwappable = isSwappableScalar<T> || isSwappableRecord<T>();
+
+    // Reverse the bytes of a scalar, or of each field of a record
+    template<typename T>
+    void byteSwap(T& value) {
+      if constexpr (isSwappableRecord<T>()) {
+        forEachField(value, [](auto& field) { byteSwap(field); return true; });
+      }
+      else {
+        unsigned char bytes[sizeof(T)];
+        std::memcpy(bytes, &value, sizeof(T));
+        for (size_t i = 0; i < sizeof(T) / 2; ++i) {
+          std::swap(bytes[i], bytes[sizeof(T) - 1 - i]);
+        }
+        std::memcpy(&value, bytes, sizeof(T));
+      }
+    }
+
+    // Read up to n records with a single istream::read
+    //  - returns the number of whole records read
+    //  - a partial record at the end sets failbit but not
+    //    eofbit, so it is reported as a failure, not as eof
+    template<typename T>
+    size_t readRecords(std::istream& in, T* out, size_t n, bool swap, size_t& consumed) {
+      if constexpr (!std::is_trivially_copyable_v<T>) {
+        in.setstate(std::ios_base::failbit);
+        return 0;
+      }
+      else {
+        if constexpr (!isSwappable<T>) {
+          if (swap) {
+            in.setstate(std::ios_base::failbit);
+            return 0;
+          }
+        }
+        in.read(reinterpret_cast<char*>(out), static_cast<std::streamsize>(n * sizeof(T)));
+        size_t bytes = static_cast<size_t>(in.gcount());
+        consumed += bytes;
+        size_t got = bytes / sizeof(T);
+        if (bytes % sizeof(T)) {
+          in.clear(in.rdstate() & ~std::ios_base::eofbit);
+        }
+        if constexpr (isSwappable<T>) {
+          if (swap) {
+            for (size_t i = 0; i < got; ++i) {
+              byteSwap(out[i]);
+            }
+          }
+        }
+        return got;
+      }
+    }
+
+    /*------------------------------------------------------
+     * Access to the get area of an arbitrary streambuf
+     *  - the get area is protected, but a pointer to member
+     *    formed through a derived class may be applied to any
+     *    streambuf
+     */
+    struct GetArea : std::streambuf {
+      static
+      char* begin(std::streambuf& buf) {
+        return (buf.*&GetArea::gptr)();
+      }
+
+      static
+      char* end(std::streambuf& buf) {
+        return (buf.*&GetArea::egptr)();
+      }
+
+      static
+      void advance(std::streambuf& buf, ptrdiff_t n) {
+        for (; n > INT_MAX; n -= INT_MAX) {
+          (buf.*&GetArea::gbump)(INT_MAX);
+        }
+        (buf.*&GetArea::gbump)(static_cast<int>(n));
+      }
+    };
+
+    /*------------------------------------------------------
+     * Character classification (the "C" locale's whitespace)
+     *  - runs of characters are scanned with the SIMD kernel
+     *    selected for this CPU
+     */
+    constexpr
+    bool isSpace(char c) {
+      return c == ' ' || (c >= '\t' && c <= '\r');
+    }
+
+    inline
+    char const* skipSpace(char const* first, char const* last) {
+      return first + simd::kernel().skipSpace(first, static_cast<size_t>(last - first));
+    }
+
+    inline
+    char const* findSpace(char const* first, char const* last) {
+      return first + simd::kernel().findSpace(first, static_cast<size_t>(last - first));
+    }
+
+    /*------------------------------------------------------
+     * Buffer refill
+     *  - flushes the tied stream first, as a sentry would
+     */
+    inline
+    int underflow(std::istream& in, std::streambuf& buf) {
+      if (in.tie()) {
+        in.tie()->flush();
+      }
+      return buf.sgetc();
+    }
+
+    inline
+    bool isEof(int c) {
+      return std::char_traits<char>::eq_int_type(c, std::char_traits<char>::eof());
+    }
+
+    // Holds tokens that straddle a buffer boundary
+    inline
+    std::string& scratch() {
+      thread_local std::string buffer;
+      return buffer;
+    }
+
+    /*------------------------------------------------------
+     * Read the next whitespace-delimited token
+     *  - leading whitespace and the token are consumed; the
+     *    delimiter that follows is not
+     *  - the view is valid until the next operation on the
+     *    stream's buffer
+     *  - sets eofbit if input ended while reading, and also
+     *    failbit if there was no token
+     *  - adds the number of characters consumed to consumed
+     */
+    inline
+    std::string_view nextToken(std::istream& in, std::ios_base::iostate& err, size_t& consumed) {
+      std::streambuf& buf = *in.rdbuf();
+
+      // skip whitespace
+      for (;;) {
+        char* first = GetArea::begin(buf);
+        char* last = GetArea::end(buf);
+        if (first == last) {
+          int c = underflow(in, buf);
+          if (isEof(c)) {
+            err |= std::ios_base::eofbit | std::ios_base::failbit;
+            return {};
+          }
+          if (GetArea::begin(buf) == GetArea::end(buf)) {
+            // unbuffered streambuf: one character at a time
+            if (!isSpace(static_cast<char>(c))) {
+              break;
+            }
+            buf.sbumpc();
+            ++consumed;
+          }
+          continue;
+        }
+        char const* next = skipSpace(first, last);
+        GetArea::advance(buf, next - first);
+        consumed += static_cast<size_t>(next - first);
+        if (next != last) {
+          break;
+        }
+      }
+
+      // common case: the token is wholly inside the buffer
+      char* first = GetArea::begin(buf);
+      char* last = GetArea::end(buf);
+      if (first != last) {
+        char const* next = findSpace(first, last);
+        if (next != last) {
+          GetArea::advance(buf, next - first);
+          consumed += static_cast<size_t>(next - first);
+          return { first, static_cast<size_t>(next - first) };
+        }
+      }
+
+      // token straddles a refill
+      std::string& token = scratch();
+      token.clear();
+      for (;;) {
+        first = GetArea::begin(buf);
+        last = GetArea::end(buf);
+        if (first == last) {
+          int c = underflow(in, buf);
+          if (isEof(c)) {
+            err |= std::ios_base::eofbit;
+            break;
+          }
+          if (GetArea::begin(buf) == GetArea::end(buf)) {
+            if (isSpace(static_cast<char>(c))) {
+              break;
+            }
+            token.push_back(static_cast<char>(c));
+            buf.sbumpc();
+            ++consumed;
+          }
+          continue;
+        }
+        char const* next = findSpace(first, last);
+        token.append(first, static_cast<size_t>(next - first));
+        GetArea::advance(buf, next - first);
+        consumed += static_cast<size_t>(next - first);
+        if (next != last) {
+          break;
+        }
+      }
+      return token;
+    }
+
+    /*------------------------------------------------------
+     * Skip the rest of the token at the current position
+     *  - used to recover from operator >>, which may stop
+     *    partway into a token it cannot convert
+     *  - returns false if already at whitespace (or the end)
+     */
+    inline
+    bool skipToken(std::istream& in) {
+      std::streambuf& buf = *in.rdbuf();
+      bool moved = false;
+      for (;;) {
+        char* first = GetArea::begin(buf);
+        char* last = GetArea::end(buf);
+        if (first == last) {
+          int c = underflow(in, buf);
+          if (isEof(c)) {
+            in.setstate(std::ios_base::eofbit);
+            return moved;
+          }
+          if (GetArea::begin(buf) == GetArea::end(buf)) {
+            if (isSpace(static_cast<char>(c))) {
+              return moved;
+            }
+            buf.sbumpc();
+            moved = true;
+          }
+          continue;
+        }
+        char const* next = findSpace(first, last);
+        GetArea::advance(buf, next - first);
+        moved = moved || next != first;
+        if (next != last) {
+          return moved;
+        }
+      }
+    }
+
+    /*------------------------------------------------------
+     * Skip up to n whole tokens without converting them
+     *  - stops just after the nth token, where reading it
+     *    would have stopped
+     *  - in memory: returns where it stopped, and decrements n
+     *    once per token skipped
+     *  - in a stream: returns the number skipped, and adds the
+     *    characters consumed to consumed; sets eofbit if it
+     *    reaches the end
+     */
+    inline
+    char const* skipTokens(char const* first, char const* last, size_t& n) {
+      if (n == 0) {
+        return first;
+      }
+      bool inToken = false;
+      first += simd::kernel().skipTokens(first, static_cast<size_t>(last - first), n, inToken);
+      if (inToken) {
+        --n;
+      }
+      return first;
+    }
+
+    inline
+    size_t skipTokens(std::istream& in, size_t n, size_t& consumed) {
+      std::streambuf& buf = *in.rdbuf();
+      size_t remaining = n;
+      bool inToken = false;
+      while (remaining) {
+        char* first = GetArea::begin(buf);
+        char* last = GetArea::end(buf);
+        if (first == last) {
+          int c = underflow(in, buf);
+          if (isEof(c)) {
+            in.setstate(std::ios_base::eofbit);
+            remaining -= inToken;
+            break;
+          }
+          if (GetArea::begin(buf) == GetArea::end(buf)) {
+            // unbuffered: one character at a time
+            bool space = isSpace(static_cast<char>(c));
+            if (space && inToken && --remaining == 0) {
+              break;
+            }
+            inToken = !space;
+            buf.sbumpc();
+            ++consumed;
+          }
+          continue;
+        }
+        size_t offset = simd::kernel().skipTokens(first, static_cast<size_t>(last - first), remaining, inToken);
+        GetArea::advance(buf, static_cast<ptrdiff_t>(offset));
+        consumed += offset;
+      }
+      return n - remaining;
+    }
+
+    /*------------------------------------------------------
+     * Convert decimal digits to an integer
+     *  - up to 19 digits go through the eight-at-a-time
+     *    kernel; longer tokens (leading zeros) use from_chars
+     *  - an unsigned value may be negative, and wraps, as
+     *    operator >> (num_get, following strtoul) reads it:
+     *    "-5" is the largest value less 4
+     */
+    template<typename T>
+    bool parseInteger(char const* first, char const* last, T& value) {
+      using U = std::make_unsigned_t<T>;
+      char const* digits = first;
+      bool negative = false;
+      if (digits != last && *digits == '-') {
+        negative = true;
+        ++digits;
+      }
+      if (digits == last || last - digits > 19) {
+        if constexpr (std::is_signed_v<T>) {
+          auto [ptr, ec] = std::from_chars(first, last, value);
+          return ec == std::errc() && ptr == last;
+        }
+        else {
+          U magnitude;
+          auto [ptr, ec] = std::from_chars(digits, last, magnitude);
+          if (ec != std::errc() || ptr != last) {
+            return false;
+          }
+          value = negative ? U(0) - magnitude : magnitude;
+          return true;
+        }
+      }
+      uint64_t magnitude;
+      if (!simd::parseDigits(digits, last, magnitude)) {
+        return false;
+      }
+      uint64_t limit = static_cast<uint64_t>(std::numeric_limits<T>::max()) + (std::is_signed_v<T> && negative ? 1 : 0);
+      if (magnitude > limit) {
+        return false;
+      }
+      value = static_cast<T>(negative ? U(0) - static_cast<U>(magnitude) : static_cast<U>(magnitude));
+      return true;
+    }
+
+    // Whether a decimal floating point token that from_chars
+    // found out of range is below 1 in magnitude, so it
+    // underflowed rather than overflowed
+    inline
+    bool belowOne(char const* first, char const* last) {
+      if (first != last && *first == '-') {
+        ++first;
+      }
+      while (first != last && *first == '0') {
+        ++first;
+      }
+      long long order = 0;
+      for (; first != last && *first >= '0' && *first <= '9'; ++first) {
+        ++order;
+      }
+      if (order == 0 && first != last && *first == '.') {
+        for (++first; first != last && *first == '0'; ++first) {
+          --order;
+        }
+      }
+      while (first != last && (*first | 0x20) != 'e') {
+        ++first;
+      }
+      if (first == last) {
+        return order <= 0;
+      }
+      ++first;
+      bool negative = first != last && *first == '-';
+      if (first != last && (*first == '-' || *first == '+')) {
+        ++first;
+      }
+      long long exponent = 0;
+      for (; first != last && exponent < 1000000000; ++first) {
+        exponent = 10 * exponent + (*first - '0');
+      }
+      return order + (negative ? -exponent : exponent) <= 0;
+    }
+
+    /*------------------------------------------------------
+     * Convert a complete token to a number
+     *  - accepts what operator >> accepts in the "C" locale
+     *    (with no thousands grouping), including a leading '+'
+     *    and, for unsigned types, a leading '-'
+     *  - trailing characters make the whole token invalid
+     *  - floating point values are correctly rounded and
+     *    locale independent; "inf", "nan" and hexadecimal
+     *    floats, which from_chars takes but operator >> does
+     *    not, are rejected
+     *  - a value too small for T is its signed zero, as strtod
+     *    and operator >> give it, where from_chars reports it
+     *    out of range; a value too large fails in both
+     */
+    template<typename T>
+    bool parseNumber(std::string_view token, T& value) {
+      char const* first = token.data();
+      char const* last = first + token.size();
+      if (first != last && *first == '+') {
+        ++first;
+        if (first != last && *first == '-') {
+          return false;
+        }
+      }
+      if constexpr (std::is_integral_v<T>) {
+        return parseInteger(first, last, value);
+      }
+      else {
+        char const* digits = first != last && *first == '-' ? first + 1 : first;
+        if (digits == last || !((*digits >= '0' && *digits <= '9') || *digits == '.')) {
+          return false;
+        }
+        auto [ptr, ec] = std::from_chars(first, last, value);
+        if (ec == std::errc::result_out_of_range && ptr == last && belowOne(first, last)) {
+          value = digits == first ? T(0) : -T(0);
+          return true;
+        }
+        return ec == std::errc() && ptr == last;
+      }
+    }
+
+    /*------------------------------------------------------
+     * Digits in other bases
+     *  - digitValues maps a character to its digit value (0 to
+     *    35), or 0xff if it is not a digit in any base
+     *  - at most 16 significant hex digits, or as many digits
+     *    as fit, so no overflow goes unnoticed
+     */
+    inline constexpr auto digitValues = [] {
+      std::array<unsigned char, 256> table{};
+      for (unsigned c = 0; c < 256; ++c) {
+        table[c] = c >= '0' && c <= '9' ? static_cast<unsigned char>(c - '0')
+                 : c >= 'a' && c <= 'z' ? static_cast<unsigned char>(c - 'a' + 10)
+                 : c >= 'A' && c <= 'Z' ? static_cast<unsigned char>(c - 'A' + 10)
+                 : 0xff;
+      }
+      return table;
+    }();
+
+    template<typename T>
+    bool parseRadix(char const* first, char const* last, T& value, unsigned base) {
+      bool negative = false;
+      if constexpr (std::is_signed_v<T>) {
+        if (first != last && *first == '-') {
+          negative = true;
+          ++first;
+        }
+      }
+      if (base == 16 && last - first > 2 && first[0] == '0' && (first[1] | 0x20) == 'x') {
+        first += 2;
+      }
+      if (first == last || base < 2 || base > 36) {
+        return false;
+      }
+      using U = std::make_unsigned_t<T>;
+      uint64_t limit = static_cast<uint64_t>(std::numeric_limits<T>::max()) + (negative ? 1 : 0);
+      uint64_t magnitude = 0;
+      if (base == 16) {
+        // no check per digit: sixteen digits cannot overflow
+        while (last - first > 1 && *first == '0') {
+          ++first;
+        }
+        if (last - first > 16) {
+          return false;
+        }
+        unsigned bad = 0;
+        for (; first != last; ++first) {
+          unsigned digit = digitValues[static_cast<unsigned char>(*first)];
+          bad |= digit & 0xf0;
+          magnitude = magnitude << 4 | (digit & 0x0f);
+        }
+        if (bad) {
+          return false;
+        }
+      }
+      else {
+        for (; first != last; ++first) {
+          unsigned digit = digitValues[static_cast<unsigned char>(*first)];
+          if (digit >= base || magnitude > (limit - digit) / base) {
+            return false;
+          }
+          magnitude = magnitude * base + digit;
+        }
+      }
+      if (magnitude > limit) {
+        return false;
+      }
+      value = static_cast<T>(negative ? U(0) - static_cast<U>(magnitude) : static_cast<U>(magnitude));
+      return true;
+    }
+
+    // Decimal digits with decimals implied places, e.g. "-1.5"
+    // with 3 places is -1500
+    template<typename T>
+    bool parseFixed(char const* first, char const* last, T& value, unsigned decimals) {
+      constexpr uint64_t powers[] = {
+        1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000,
+        10000000000, 100000000000, 1000000000000, 10000000000000, 100000000000000,
+        1000000000000000, 10000000000000000, 100000000000000000, 1000000000000000000,
+        10000000000000000000u,
+      };
+      bool negative = false;
+      if constexpr (std::is_signed_v<T>) {
+        if (first != last && *first == '-') {
+          negative = true;
+          ++first;
+        }
+      }
+      char const* dot = static_cast<char const*>(std::memchr(first, '.', static_cast<size_t>(last - first)));
+      char const* whole = dot ? dot : last;
+      char const* fraction = dot ? dot + 1 : last;
+      if (first == whole && fraction == last) {
+        return false;
+      }
+      while (last - fraction > static_cast<ptrdiff_t>(decimals) && last[-1] == '0') {
+        --last;
+      }
+      size_t places = static_cast<size_t>(last - fraction);
+      if (places > decimals) {
+        return false;
+      }
+      while (whole - first > 1 && *first == '0') {
+        ++first;
+      }
+      if (static_cast<size_t>(whole - first) + decimals > 19) {
+        return false;
+      }
+      uint64_t integer = 0;
+      uint64_t fractional = 0;
+      if (!simd::parseDigits(first, whole, integer) || !simd::parseDigits(fraction, last, fractional)) {
+        return false;
+      }
+      uint64_t magnitude = integer * powers[decimals] + fractional * powers[decimals - places];
+      using U = std::make_unsigned_t<T>;
+      uint64_t limit = static_cast<uint64_t>(std::numeric_limits<T>::max()) + (negative ? 1 : 0);
+      if (magnitude > limit) {
+        return false;
+      }
+      value = static_cast<T>(negative ? U(0) - static_cast<U>(magnitude) : static_cast<U>(magnitude));
+      return true;
+    }
+
+    /*------------------------------------------------------
+     * Types parseToken handles without operator >>
+     */
+    // std::string with any allocator (e.g. std::pmr::string)
+    template<typename T>
+    inline constexpr bool isString = false;
+
+    template<typename Alloc>
+    inline constexpr bool isString<std::basic_string<char, std::char_traits<char>, Alloc>> = true;
+
+    template<typename T>
+    inline constexpr bool hasTokenParser =
+      isNumber<T>
+      || isString<T>
+      || std::is_same_v<T, std::string_view>;
+
+    // Types with an operator >>
+    template<typename T, typename = void>
+    inline constexpr bool isExtractable = false;
+
+    template<typename T>
+    inline constexpr bool isExtractable<T, std::void_t<decltype(std::declval<std::istream&>() >> std::declval<T&>())>> = true;
+
+    // Streambuf that reads from a single token
+    struct TokenBuf : std::streambuf {
+      explicit
+      TokenBuf(std::string_view token) {
+        char* first = const_cast<char*>(token.data());
+        setg(first, first, first + token.size());
+      }
+    };
+
+    /*------------------------------------------------------
+     * Convert a complete token to a value
+     *  - string_view values refer to the token's characters
+     *  - types without a token parser use operator >> and
+     *    must consume the whole token; types without one
+     *    never convert
+     */
+    template<typename T>
+    bool parseToken(std::string_view token, T& value) {
+      if constexpr (isNumber<T>) {
+        return parseNumber(token, value);
+      }
+      else if constexpr (std::is_same_v<T, std::string_view>) {
+        value = token;
+        return true;
+      }
+      else if constexpr (isString<T>) {
+        value.assign(token.data(), token.size());
+        return true;
+      }
+      else if constexpr (isExtractable<T>) {
+        TokenBuf buf(token);
+        std::istream in(&buf);
+        in >> value;
+        return !in.fail() && isEof(in.peek());
+      }
+      else {
+        return false;
+      }
+    }
+
+    // Convert a token written in format; only integral numbers
+    // have other formats than decimal
+    template<typename T>
+    bool parseToken(std::string_view token, T& value, NumberFormat format) {
+      if constexpr (isNumber<T> && std::is_integral_v<T>) {
+        if (!format.isDecimal()) {
+          char const* first = token.data();
+          char const* last = first + token.size();
+          if (first != last && *first == '+') {
+            ++first;
+            if (first != last && *first == '-') {
+              return false;
+            }
+          }
+          return format.decimals ? parseFixed(first, last, value, format.decimals)
+                                 : parseRadix(first, last, value, format.base);
+        }
+      }
+      return parseToken(token, value);
+    }
+
+    /*------------------------------------------------------
+     * Buffered replacement for in >> value
+     *  - sets the same state bits operator >> would; a token
+     *    that fails to convert is consumed and sets failbit
+     *    only, so it is reported rather than mistaken for eof
+     *  - adds the number of characters consumed to consumed
+     */
+    template<typename T>
+    void extract(std::istream& in, T& value, size_t& consumed, NumberFormat format = {}) {
+      if (!in.good()) {
+        in.setstate(std::ios_base::failbit);
+        return;
+      }
+      std::ios_base::iostate err = std::ios_base::goodbit;
+      std::string_view token = nextToken(in, err, consumed);
+      if (!(err & std::ios_base::failbit) && !parseToken(token, value, format)) {
+        err = std::ios_base::failbit;
+      }
+      if (err) {
+        in.setstate(err);
+      }
+    }
+
+    template<typename T>
+    void extract(std::istream& in, T& value) {
+      size_t consumed = 0;
+      extract(in, value, consumed);
+    }
+
+  }
+
+}
@@ -0,0 +1,194 @@
+// Copyright 2023, Gabriel Foust, All rights reserved
+#pragma once
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <streambuf>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace cgf {
+
+  /*========================================================
+   * PrefetchBuf
+   *  - a streambuf that reads its source on a background
+   *    thread, filling one buffer while the consumer parses
+   *    another, so I/O latency overlaps with parsing
+   *  - bufferCount buffers of bufferSize bytes each; the
+   *    consumer holds at most one of them at a time
+   *  - the source is read ahead, so its own position after
+   *    this buffer is done is unspecified
+   *  - an exception thrown by the source is rethrown from
+   *    the read that reaches it
+   *  - a Fill function may stand in for the source: it is
+   *    called on the background thread to fill a block, and
+   *    returns the bytes it wrote (0 at the end)
+   */
+  class PrefetchBuf : public std::streambuf {
+  public:
+    using Fill = std::function<size_t(char*, size_t)>;
+
+    explicit
+    PrefetchBuf(std::streambuf& source, size_t bufferSize = 1 << 20, size_t bufferCount = 2)
+      : PrefetchBuf(Fill([&source](char* block, size_t size) {
+                      std::streamsize got = source.sgetn(block, static_cast<std::streamsize>(size));
+                      return got > 0 ? static_cast<size_t>(got) : 0;
+                    }),
+                    bufferSize, bufferCount) {
+    }
+
+    explicit
+    PrefetchBuf(Fill fill, size_t bufferSize = 1 << 20, size_t bufferCount = 2)
+      : _fill{ std::move(fill) },
+        _size{ std::max<size_t>(1, bufferSize) },
+        _sizes(std::max<size_t>(2, bufferCount)) {
+      for (size_t i = 0; i < _sizes.size(); ++i) {
+        _blocks.emplace_back(new char[_size]);
+      }
+      _thread = std::thread([this] { produce(); });
+    }
+
+    PrefetchBuf(PrefetchBuf const&) = delete;
+    PrefetchBuf& operator =(PrefetchBuf const&) = delete;
+
+    // Waits for a read in progress on the source to return
+    ~PrefetchBuf() override {
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+      }
+      _space.notify_one();
+      _thread.join();
+    }
+
+  protected:
+    int_type underflow() override {
+      std::unique_lock<std::mutex> lock(_mutex);
+      if (_holding) {
+        ++_released;
+        _holding = false;
+        _space.notify_one();
+      }
+      _ready.wait(lock, [this] { return _filled > _taken || _done; });
+      if (_filled == _taken) {
+        setg(nullptr, nullptr, nullptr);
+        if (_error) {
+          std::rethrow_exception(std::exchange(_error, nullptr));
+        }
+        return traits_type::eof();
+      }
+      size_t index = _taken++ % _blocks.size();
+      _holding = true;
+      lock.unlock();
+
+      char* first = _blocks[index].get();
+      setg(first, first, first + _sizes[index]);
+      return traits_type::to_int_type(*first);
+    }
+
+  private:
+    // Background thread: fill free buffers until the source ends
+    void produce() {
+      for (;;) {
+        size_t index;
+        {
+          std::unique_lock<std::mutex> lock(_mutex);
+          _space.wait(lock, [this] { return _stop || _filled < _released + _blocks.size(); });
+          if (_stop) {
+            return;
+          }
+          index = _filled % _blocks.size();
+        }
+
+        size_t got = 0;
+        std::exception_ptr error;
+        try {
+          got = _fill(_blocks[index].get(), _size);
+        }
+        catch (...) {
+          error = std::current_exception();
+        }
+
+        {
+          std::lock_guard<std::mutex> lock(_mutex);
+          if (error || got == 0) {
+            _error = error;
+            _done = true;
+          }
+          else {
+            _sizes[index] = got;
+            ++_filled;
+          }
+        }
+        _ready.notify_one();
+        if (error || got == 0) {
+          return;
+        }
+      }
+    }
+
+    Fill _fill;
+    size_t _size;
+    std::vector<size_t> _sizes;
+    std::vector<std::unique_ptr<char[]>> _blocks;
+
+    // buffers are used in rotation; counts only increase
+    size_t _filled = 0;      // buffers filled by the producer
+    size_t _taken = 0;       // buffers taken by the consumer
+    size_t _released = 0;    // buffers handed back
+    bool _holding = false;
+    bool _done = false;
+    bool _stop = false;
+    std::exception_ptr _error;
+
+    std::mutex _mutex;
+    std::condition_variable _ready;
+    std::condition_variable _space;
+    std::thread _thread;
+  };
+
+  /*========================================================
+   * PrefetchStream
+   *  - an istream over a PrefetchBuf, for use anywhere an
+   *    std::istream& is accepted (e.g. scan<T>)
+   *  - either wraps another stream's buffer or opens a file
+   */
+  class PrefetchStream : public std::istream {
+  public:
+    explicit
+    PrefetchStream(std::istream& source, size_t bufferSize = 1 << 20, size_t bufferCount = 2)
+      : std::istream(nullptr),
+        _buf{ std::make_unique<PrefetchBuf>(*source.rdbuf(), bufferSize, bufferCount) } {
+      rdbuf(_buf.get());
+    }
+
+    explicit
+    PrefetchStream(char const* path, size_t bufferSize = 1 << 20, size_t bufferCount = 2)
+      : std::istream(nullptr) {
+      if (_file.open(path, std::ios_base::in | std::ios_base::binary)) {
+        _buf = std::make_unique<PrefetchBuf>(_file, bufferSize, bufferCount);
+        rdbuf(_buf.get());
+      }
+      else {
+        setstate(std::ios_base::failbit);
+      }
+    }
+
+    // The prefetch thread stops before the file it reads closes
+    ~PrefetchStream() override {
+      _buf.reset();
+    }
+
+  private:
+    std::filebuf _file;
+    std::unique_ptr<PrefetchBuf> _buf;
+  };
+
+}
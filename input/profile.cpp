@@ -0,0 +1,500 @@
+// Copyright 2023, Gabriel Foust, All rights reserved
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "input.hpp"
+
+/*========================================================
+ * Per-stage profiling
+ *  - runs each stage of parsing on its own, over generated
+ *    corpora, and reports cycles, instructions, branch misses
+ *    and cache misses per byte from the hardware counters
+ *    (perf_event_open), as JSON on stdout, so runs can be
+ *    compared across releases and CPUs
+ *  - stages, each timed over a whole corpus:
+ *      fill      reading the corpus file through a streambuf
+ *      scan      finding token boundaries (the SIMD kernel)
+ *      convert   converting tokens already cut out
+ *      dispatch  iterating string_views: scanning plus the
+ *                iterator's comparison and dispatch
+ *      iterate   the whole IstreamIterator loop
+ *  - each stage is a separate non-inlined function, built
+ *    with frame pointers, so running one stage repeatedly
+ *    gives a clean profile to record, e.g.
+ *      perf record -g ./profile --filter double/long/iterate --repetitions 50
+ *  - where counters are unavailable (perf_event_paranoid, or
+ *    a container), they are reported as null and only times
+ *    are measured; kernel time is counted where permitted,
+ *    which matters for fill
+ *  - options: --tokens N (default 1M), --repetitions N (the
+ *    best is reported; default 5), --filter TEXT (runs only
+ *    corpus/stage names containing it)
+ */
+
+namespace {
+
+  /*------------------------------------------------------
+   * Hardware counters
+   */
+  class Counters {
+  public:
+    static constexpr int count = 4;
+
+    Counters() {
+      // count the kernel too if allowed, else only user space
+      for (bool excludeKernel : { false, true }) {
+        if (open(excludeKernel)) {
+          _kernel = !excludeKernel;
+          return;
+        }
+      }
+    }
+
+    Counters(Counters const&) = delete;
+    Counters& operator =(Counters const&) = delete;
+
+    ~Counters() {
+      close();
+    }
+
+    bool available() const {
+      return _fds[0] >= 0;
+    }
+
+    bool kernel() const {
+      return _kernel;
+    }
+
+    void start() {
+      if (available()) {
+        ioctl(_fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(_fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+      }
+    }
+
+    // cycles, instructions, branch misses and cache misses
+    // since start, scaled up if the counters were multiplexed
+    bool stop(uint64_t (&values)[count]) {
+      if (!available()) {
+        return false;
+      }
+      ioctl(_fds[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+      // nr, time enabled, time running, then one value each
+      uint64_t data[3 + count];
+      if (read(_fds[0], data, sizeof data) != static_cast<ssize_t>(sizeof data) || data[0] != count || !data[2]) {
+        return false;
+      }
+      double scale = static_cast<double>(data[1]) / static_cast<double>(data[2]);
+      for (int i = 0; i < count; ++i) {
+        values[i] = static_cast<uint64_t>(static_cast<double>(data[3 + i]) * scale);
+      }
+      return true;
+    }
+
+  private:
+    bool open(bool excludeKernel) {
+      static constexpr uint64_t events[count] = {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_BRANCH_MISSES,
+        PERF_COUNT_HW_CACHE_MISSES,
+      };
+      for (int i = 0; i < count; ++i) {
+        perf_event_attr attr{};
+        attr.size = sizeof attr;
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = events[i];
+        attr.disabled = i == 0;
+        attr.exclude_kernel = excludeKernel;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        _fds[i] = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, i == 0 ? -1 : _fds[0], 0));
+        if (_fds[i] < 0) {
+          close();
+          return false;
+        }
+      }
+      return true;
+    }
+
+    void close() {
+      for (int& fd : _fds) {
+        if (fd >= 0) {
+          ::close(fd);
+          fd = -1;
+        }
+      }
+    }
+
+    int _fds[count] = { -1, -1, -1, -1 };
+    bool _kernel = false;
+  };
+
+  // Keep the compiler from discarding a value
+  template<typename T>
+  void keep(T const& value) {
+    asm volatile("" : : "g"(&value) : "memory");
+  }
+
+  /*------------------------------------------------------
+   * Corpora
+   */
+  enum class Kind {
+    ShortInt,
+    LongDouble,
+    MixedWord,
+  };
+
+  struct Corpus {
+    char const* name;
+    Kind kind;
+    std::string text;
+    std::string path;
+  };
+
+  std::string generate(Kind kind, size_t tokens) {
+    std::mt19937_64 rng(42);
+    std::string text;
+    char buffer[32];
+    for (size_t i = 0; i < tokens; ++i) {
+      switch (kind) {
+      case Kind::ShortInt:
+        text += std::to_string(rng() % 1000);
+        break;
+      case Kind::LongDouble: {
+        // full precision, as written by a program saving doubles
+        double value = std::uniform_real_distribution<double>(-1, 1)(rng) * std::pow(10.0, static_cast<int>(rng() % 40) - 20);
+        auto result = std::to_chars(buffer, buffer + sizeof buffer, value, std::chars_format::general, 17);
+        text.append(buffer, result.ptr);
+        break;
+      }
+      case Kind::MixedWord:
+        // mostly lower case words, with some capitalized, some
+        // with digits or punctuation
+        for (size_t k = 1 + rng() % 10; k; --k) {
+          unsigned r = static_cast<unsigned>(rng() % 40);
+          text += r < 30 ? static_cast<char>('a' + r % 26)
+                : r < 34 ? static_cast<char>('A' + rng() % 26)
+                : r < 38 ? static_cast<char>('0' + r - 34)
+                : ",."[r - 38];
+        }
+        break;
+      }
+      text += rng() % 8 ? ' ' : '\n';
+    }
+    return text;
+  }
+
+  /*------------------------------------------------------
+   * Stages
+   *  - each returns the number of tokens it handled (fill,
+   *    the bytes it read), as a check that the stages saw the
+   *    same input
+   */
+
+  __attribute__((noinline))
+  size_t stageFill(Corpus const& corpus) {
+    std::ifstream in(corpus.path, std::ios_base::binary);
+    std::vector<char> buffer(size_t(1) << 16);
+    size_t bytes = 0;
+    std::streamsize got;
+    while ((got = in.rdbuf()->sgetn(buffer.data(), static_cast<std::streamsize>(buffer.size()))) > 0) {
+      keep(buffer[0]);
+      bytes += static_cast<size_t>(got);
+    }
+    return bytes;
+  }
+
+  __attribute__((noinline))
+  size_t stageScan(Corpus const& corpus) {
+    size_t remaining = static_cast<size_t>(-1);
+    char const* first = corpus.text.data();
+    char const* next = cgf::detail::skipTokens(first, first + corpus.text.size(), remaining);
+    keep(next);
+    return static_cast<size_t>(-1) - remaining;
+  }
+
+  template<typename T>
+  __attribute__((noinline))
+  size_t stageConvert(std::vector<std::string_view> const& tokens) {
+    T value{};
+    size_t n = 0;
+    for (std::string_view token : tokens) {
+      n += cgf::detail::parseToken(token, value);
+      keep(value);
+    }
+    return n;
+  }
+
+  __attribute__((noinline))
+  size_t stageDispatch(Corpus const& corpus) {
+    size_t n = 0;
+    char const* first = corpus.text.data();
+    auto end = cgf::untilEof<std::string_view>();
+    for (cgf::IstreamIterator<std::string_view> p(first, first + corpus.text.size()); p != end; ++p) {
+      keep(*p);
+      ++n;
+    }
+    return n;
+  }
+
+  template<typename T>
+  __attribute__((noinline))
+  size_t stageIterate(Corpus const& corpus) {
+    size_t n = 0;
+    char const* first = corpus.text.data();
+    auto end = cgf::untilEof<T>();
+    for (cgf::IstreamIterator<T> p(first, first + corpus.text.size()); p != end; ++p) {
+      keep(*p);
+      ++n;
+    }
+    return n;
+  }
+
+  std::vector<std::string_view> split(std::string const& text) {
+    std::vector<std::string_view> tokens;
+    char const* first = text.data();
+    for (cgf::IstreamIterator<std::string_view> p(first, first + text.size()), end; p != end; ++p) {
+      tokens.push_back(*p);
+    }
+    return tokens;
+  }
+
+  /*------------------------------------------------------
+   * Measurement and report
+   */
+  struct Options {
+    size_t tokens = 1000000;
+    int repetitions = 5;
+    std::string filter;
+  };
+
+  // The best of the repetitions: fewest cycles when counted,
+  // else shortest time
+  struct Sample {
+    double seconds = 0;
+    bool counted = false;
+    uint64_t values[Counters::count] = {};
+    size_t tokens = 0;
+  };
+
+  Sample measure(Counters& counters, int repetitions, std::function<size_t()> const& stage) {
+    Sample best;
+    for (int i = 0; i < repetitions; ++i) {
+      Sample sample;
+      counters.start();
+      auto start = std::chrono::steady_clock::now();
+      sample.tokens = stage();
+      auto elapsed = std::chrono::steady_clock::now() - start;
+      sample.counted = counters.stop(sample.values);
+      sample.seconds = std::chrono::duration<double>(elapsed).count();
+      bool better = sample.counted ? sample.values[0] < best.values[0] : sample.seconds < best.seconds;
+      if (i == 0 || better) {
+        best = sample;
+      }
+    }
+    return best;
+  }
+
+  std::string cpuName() {
+    std::ifstream in("/proc/cpuinfo");
+    std::string line;
+    while (std::getline(in, line)) {
+      if (line.compare(0, 10, "model name") == 0) {
+        size_t colon = line.find(':');
+        if (colon != std::string::npos) {
+          return line.substr(line.find_first_not_of(' ', colon + 1));
+        }
+      }
+    }
+    return "unknown";
+  }
+
+  // A JSON string; names here never need more than quotes
+  std::string quoted(std::string_view text) {
+    std::string result = "\"";
+    for (char c : text) {
+      if (c == '"' || c == '\\') {
+        result += '\\';
+      }
+      result += c;
+    }
+    return result + '"';
+  }
+
+  // A JSON number, or null for inf and nan, which JSON cannot
+  // hold (e.g. per byte of an empty corpus)
+  std::string number(double value, char const* format = "%g") {
+    if (!std::isfinite(value)) {
+      return "null";
+    }
+    char buffer[32];
+    std::snprintf(buffer, sizeof buffer, format, value);
+    return buffer;
+  }
+
+  std::string perByte(Sample const& sample, int i, size_t bytes) {
+    if (!sample.counted) {
+      return "null";
+    }
+    return number(static_cast<double>(sample.values[i]) / static_cast<double>(bytes), "%.4f");
+  }
+
+  std::string count(Sample const& sample, int i) {
+    return sample.counted ? std::to_string(sample.values[i]) : "null";
+  }
+
+  // Removes a file when it goes out of scope, so a stage that
+  // throws leaves no corpus behind
+  class TempFile {
+  public:
+    explicit
+    TempFile(std::string path) : _path{ std::move(path) } {
+    }
+
+    TempFile(TempFile const&) = delete;
+    TempFile& operator =(TempFile const&) = delete;
+
+    ~TempFile() {
+      std::remove(_path.c_str());
+    }
+
+  private:
+    std::string _path;
+  };
+
+  Options parse(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+      std::string_view arg = argv[i];
+      if (i + 1 < argc && arg == "--tokens") {
+        options.tokens = std::strtoull(argv[++i], nullptr, 10);
+      }
+      else if (i + 1 < argc && arg == "--repetitions") {
+        options.repetitions = std::max(1, std::atoi(argv[++i]));
+      }
+      else if (i + 1 < argc && arg == "--filter") {
+        options.filter = argv[++i];
+      }
+      else {
+        std::cerr << "usage: profile [--tokens N] [--repetitions N] [--filter TEXT]\n";
+        std::exit(2);
+      }
+    }
+    return options;
+  }
+
+}
+
+int main(int argc, char** argv) {
+  Options options = parse(argc, argv);
+  Counters counters;
+
+  std::vector<Corpus> corpora = {
+    { "int/short", Kind::ShortInt, {}, {} },
+    { "double/long", Kind::LongDouble, {}, {} },
+    { "string/mixed", Kind::MixedWord, {}, {} },
+  };
+
+  std::cout << "{\n"
+            << "  \"cpu\": " << quoted(cpuName()) << ",\n"
+            << "  \"tokens\": " << options.tokens << ",\n"
+            << "  \"repetitions\": " << options.repetitions << ",\n"
+            << "  \"counters\": " << (counters.available() ? "true" : "false") << ",\n"
+            << "  \"kernel\": " << (counters.kernel() ? "true" : "false") << ",\n"
+            << "  \"results\": [";
+  char const* separator = "\n";
+  bool mismatched = false;
+  for (Corpus& corpus : corpora) {
+    corpus.text = generate(corpus.kind, options.tokens);
+    char path[] = "/tmp/cgf-profile-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+      std::cerr << "cannot create corpus file\n";
+      return 1;
+    }
+    TempFile file(path);
+    bool written = write(fd, corpus.text.data(), corpus.text.size()) == static_cast<ssize_t>(corpus.text.size());
+    ::close(fd);
+    if (!written) {
+      std::cerr << "cannot write corpus file\n";
+      return 1;
+    }
+    corpus.path = path;
+    std::vector<std::string_view> tokens = split(corpus.text);
+
+    std::vector<std::pair<char const*, std::function<size_t()>>> stages = {
+      { "fill", [&] { return stageFill(corpus); } },
+      { "scan", [&] { return stageScan(corpus); } },
+      { "convert", [&]() -> size_t {
+        switch (corpus.kind) {
+        case Kind::ShortInt: return stageConvert<int>(tokens);
+        case Kind::LongDouble: return stageConvert<double>(tokens);
+        default: return stageConvert<std::string>(tokens);
+        }
+      } },
+      { "dispatch", [&] { return stageDispatch(corpus); } },
+      { "iterate", [&]() -> size_t {
+        switch (corpus.kind) {
+        case Kind::ShortInt: return stageIterate<int>(corpus);
+        case Kind::LongDouble: return stageIterate<double>(corpus);
+        default: return stageIterate<std::string>(corpus);
+        }
+      } },
+    };
+
+    for (auto const& [stage, run] : stages) {
+      std::string name = std::string(corpus.name) + "/" + stage;
+      if (name.find(options.filter) == std::string::npos) {
+        continue;
+      }
+      Sample sample;
+      try {
+        sample = measure(counters, options.repetitions, run);
+      }
+      catch (std::exception const& e) {
+        std::cerr << name << ": " << e.what() << '\n';
+        return 1;
+      }
+      size_t bytes = corpus.text.size();
+      if (sample.tokens != (std::string_view(stage) == "fill" ? bytes : tokens.size())) {
+        std::cerr << name << ": handled " << sample.tokens << " of " << tokens.size() << " tokens\n";
+        mismatched = true;
+      }
+      std::cout << separator
+                << "    { \"name\": " << quoted(name)
+                << ", \"corpus\": " << quoted(corpus.name)
+                << ", \"stage\": " << quoted(stage)
+                << ", \"bytes\": " << bytes
+                << ", \"tokens\": " << tokens.size()
+                << ", \"seconds\": " << number(sample.seconds)
+                << ", \"bytes_per_second\": " << number(static_cast<double>(bytes) / sample.seconds)
+                << ", \"cycles_per_byte\": " << perByte(sample, 0, bytes)
+                << ", \"instructions_per_byte\": " << perByte(sample, 1, bytes)
+                << ", \"branch_misses\": " << count(sample, 2)
+                << ", \"cache_misses\": " << count(sample, 3)
+                << " }";
+      separator = ",\n";
+    }
+  }
+  std::cout << "\n  ]\n}\n";
+  return mismatched ? 1 : 0;
+}
@@ -0,0 +1,249 @@
+// Copyright 2023, Gabriel Foust, All rights reserved
+#pragma once
+#include "input.hpp"
+
+#if defined(CGF_CPP20)
+#include <concepts>
+#include <cstddef>
+#include <iterator>
+#include <ranges>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+namespace cgf {
+  namespace ranges {
+
+    /*========================================================
+     * Stopping conditions as distinct sentinel types
+     *  - each is compared directly against a ScanIterator, so
+     *    the end test is resolved at compile time
+     */
+
+    struct EofSentinel {
+    };
+
+    struct CountSentinel {
+      size_t value;
+    };
+
+    template<typename T>
+    struct ValueSentinel {
+      T value;
+    };
+
+    /*========================================================
+     * ScanIterator
+     *  - a lean input iterator: just the input state, with no
+     *    stopping conditions stored alongside it
+     *  - State is detail::InputState (a stream) or
+     *    detail::MappedState (memory)
+     */
+    template<typename T, typename State = detail::InputState<std::remove_cv_t<T>>>
+    class ScanIterator {
+    public:
+      /*------------------------------------------------------
+       * Iterator traits
+       */
+      using difference_type = ptrdiff_t;
+      using value_type = std::remove_cv_t<T>;
+      using pointer = value_type*;
+      using reference = value_type&;
+      using iterator_concept = std::input_iterator_tag;
+
+      /*------------------------------------------------------
+       * Constructors
+       */
+
+      ScanIterator() = default;
+
+      explicit
+      ScanIterator(std::istream& in, ParseMode mode = ParseMode::Stream)
+        requires std::same_as<State, detail::InputState<value_type>>
+        : _state{ {}, &in, false, {}, mode, nullptr, nullptr } {
+      }
+
+      ScanIterator(std::istream& in, value_type& buffer, ParseMode mode = ParseMode::Stream)
+        requires std::same_as<State, detail::InputState<value_type>>
+        : _state{ {}, &in, false, {}, mode, &buffer, nullptr } {
+      }
+
+      ScanIterator(char const* first, char const* last)
+        requires std::same_as<State, detail::MappedState<value_type>>
+        : _state{ {}, first, first, last, false, false, false, {}, nullptr, nullptr } {
+      }
+
+      /*------------------------------------------------------
+       * Iterator operators
+       *  - postfix increment returns nothing, as C++20 allows
+       *    for input iterators, so it never copies a value
+       */
+
+      reference operator *() const {
+        return detail::hardCommit(_state);
+      }
+
+      pointer operator ->() const {
+        return &detail::hardCommit(_state);
+      }
+
+      ScanIterator& operator ++() {
+        detail::advance(_state);
+        ++_count;
+        return *this;
+      }
+
+      void operator ++(int) {
+        ++*this;
+      }
+
+      /*------------------------------------------------------
+       * Sentinel comparisons
+       */
+
+      friend
+      bool operator ==(ScanIterator const& it, EofSentinel) {
+        detail::softCommit(it._state);
+        return detail::atEof(it._state);
+      }
+
+      friend
+      bool operator ==(ScanIterator const& it, CountSentinel end) {
+        return it._count == end.value;
+      }
+
+      template<typename U>
+      friend
+      bool operator ==(ScanIterator const& it, ValueSentinel<U> const& end) {
+        return detail::hardCommit(it._state) == end.value;
+      }
+
+      // Number of values read so far
+      size_t count() const {
+        return _count;
+      }
+
+    private:
+      State _state{};
+      size_t _count = 0;
+    };
+
+    /*========================================================
+     * Convenience factory functions
+     */
+
+    template<typename T> inline
+    ScanIterator<T> scan(std::istream& in, ParseMode mode = ParseMode::Stream) {
+      return ScanIterator<T>(in, mode);
+    }
+
+    template<typename T> inline
+    ScanIterator<T> scan(std::istream& in, T& buffer, ParseMode mode = ParseMode::Stream) {
+      return ScanIterator<T>(in, buffer, mode);
+    }
+
+    template<typename T> inline
+    ScanIterator<T, detail::MappedState<T>> scan(std::string_view text) {
+      return ScanIterator<T, detail::MappedState<T>>(text.data(), text.data() + text.size());
+    }
+
+    inline
+    EofSentinel untilEof() {
+      return {};
+    }
+
+    inline
+    CountSentinel untilCount(size_t count) {
+      return { count };
+    }
+
+    template<typename T> inline
+    ValueSentinel<T> untilSentinel(T value) {
+      return { std::move(value) };
+    }
+
+    static_assert(std::input_iterator<ScanIterator<double>>);
+    static_assert(std::sentinel_for<EofSentinel, ScanIterator<double>>);
+    static_assert(std::sentinel_for<CountSentinel, ScanIterator<double>>);
+    static_assert(std::sentinel_for<ValueSentinel<double>, ScanIterator<double>>);
+
+    /*========================================================
+     * ScanView
+     *  - every value up to end of input, as a std::ranges view
+     *  - an input view, begun once: like basic_istream_view,
+     *    begin() moves its iterator out (so a view is not const
+     *    iterable, and copies do not each carry their own
+     *    lookahead)
+     */
+    template<typename T, typename State = detail::InputState<std::remove_cv_t<T>>>
+    class ScanView : public std::ranges::view_interface<ScanView<T, State>> {
+    public:
+      ScanView() = default;
+
+      explicit
+      ScanView(ScanIterator<T, State> begin) : _begin{ std::move(begin) } {
+      }
+
+      ScanIterator<T, State> begin() {
+        return std::move(_begin);
+      }
+
+      EofSentinel end() const {
+        return {};
+      }
+
+    private:
+      ScanIterator<T, State> _begin;
+    };
+
+    static_assert(std::ranges::view<ScanView<double>>);
+    static_assert(std::ranges::input_range<ScanView<double>>);
+    static_assert(!std::ranges::range<ScanView<double> const>);
+
+  }
+
+  namespace views {
+
+    /*========================================================
+     * Range adaptor
+     *  - in | views::scan<int> | std::views::take(n) | ...
+     *  - views::scan<int>(ParseMode::Buffered) selects the
+     *    parse mode; views::scan<int>(in) is the same as
+     *    in | views::scan<int>
+     *  - string_view (and MappedFile::view()) sources yield
+     *    tokens straight from memory
+     */
+    template<typename T>
+    struct ScanAdaptor {
+      ParseMode mode = ParseMode::Stream;
+
+      constexpr
+      ScanAdaptor operator ()(ParseMode mode) const {
+        return { mode };
+      }
+
+      ranges::ScanView<T> operator ()(std::istream& in) const {
+        return ranges::ScanView<T>(ranges::ScanIterator<T>(in, mode));
+      }
+
+      ranges::ScanView<T, detail::MappedState<T>> operator ()(std::string_view text) const {
+        return ranges::ScanView<T, detail::MappedState<T>>(ranges::scan<T>(text));
+      }
+    };
+
+    template<typename T>
+    inline constexpr ScanAdaptor<T> scan{};
+
+    template<typename T> inline
+    ranges::ScanView<T> operator |(std::istream& in, ScanAdaptor<T> adaptor) {
+      return adaptor(in);
+    }
+
+    template<typename T> inline
+    ranges::ScanView<T, detail::MappedState<T>> operator |(std::string_view text, ScanAdaptor<T> adaptor) {
+      return adaptor(text);
+    }
+
+  }
+}
+#endif
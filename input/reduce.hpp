@@ -0,0 +1,412 @@
+// Copyright 2023, Gabriel Foust, All rights reserved
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <istream>
+#include <iterator>
+#include <limits>
+#include <type_traits>
+#include <vector>
+#include "input.hpp"
+
+namespace cgf {
+
+  /*========================================================
+   * Reductions
+   *  - reduce(begin, end, acc...) feeds every value between
+   *    two iterators to one or more accumulators in a single
+   *    pass; an accumulator is any callable taking a block,
+   *    (T const* values, size_t n)
+   *  - values are gathered into blocks first: an
+   *    IstreamIterator parses straight into the block (see
+   *    readInto), so any stopping condition works, and the
+   *    accumulators run tight loops the compiler vectorizes
+   *  - a failed read throws std::istream::failure
+   *  - sum, minMax, moments and histogram wrap the
+   *    accumulators below, e.g.
+   *      auto total = sum(scan<double>(in), untilEof<double>());
+   */
+
+  namespace detail {
+
+    inline constexpr size_t reduceBlockSize = 4096;
+
+    // Independent partial sums, so floating point additions
+    // need not be done in order and can be vectorized
+    inline constexpr size_t reduceLanes = 8;
+
+    template<typename It>
+    struct IsIstreamIterator : std::false_type {};
+
+    template<typename T, typename Stats>
+    struct IsIstreamIterator<IstreamIterator<T, Stats>> : std::true_type {};
+
+    template<typename T>
+    using SumType = std::conditional_t<std::is_floating_point_v<T>, T,
+                    std::conditional_t<std::is_signed_v<T>, long long, unsigned long long>>;
+
+  }
+
+  template<typename It, typename... Acc> inline
+  void reduce(It begin, It end, Acc&... acc) {
+    using T = typename std::iterator_traits<It>::value_type;
+    std::vector<T> block(detail::reduceBlockSize);
+    if constexpr (detail::IsIstreamIterator<It>::value) {
+      ReadResult result;
+      do {
+        result = begin.readInto(block.data(), block.size(), end);
+        if (result.reason == StopReason::Failure) {
+          throw std::istream::failure("input failure");
+        }
+        if (result.count) {
+          (acc(static_cast<T const*>(block.data()), result.count), ...);
+        }
+      } while (result.reason == StopReason::Full);
+    }
+    else {
+      while (begin != end) {
+        size_t n = 0;
+        for (; n < block.size() && begin != end; ++begin) {
+          block[n++] = *begin;
+        }
+        (acc(static_cast<T const*>(block.data()), n), ...);
+      }
+    }
+  }
+
+  /*========================================================
+   * Sum
+   *  - integers are summed as (unsigned) long long, floating
+   *    point values in their own type, so a sum of ints does
+   *    not overflow int; Sum<T, Acc> (or sum<Acc>) sums in
+   *    Acc instead, e.g. Sum<float, double>, or Sum<int,
+   *    double> for a total beyond long long
+   *  - floating point values are added in reduceLanes
+   *    interleaved partial sums, so the result can differ in
+   *    the last bits from adding in order; Kahan compensates
+   *    each partial sum for its rounding error (it relies on
+   *    strict floating point, so not with -ffast-math)
+   */
+  enum class Summation : unsigned char {
+    Plain,
+    Kahan,
+  };
+
+  template<typename T, typename Acc = detail::SumType<T>>
+  class Sum {
+    static_assert(std::is_arithmetic_v<T>, "Sum requires an arithmetic type");
+    static_assert(std::is_arithmetic_v<Acc>, "Sum requires an arithmetic accumulator type");
+
+  public:
+    using result_type = Acc;
+
+    explicit
+    Sum(Summation method = Summation::Plain) : _method{ method } {
+    }
+
+    void operator ()(T const* values, size_t n) {
+      if constexpr (std::is_floating_point_v<result_type>) {
+        size_t i = 0;
+        if (_method == Summation::Kahan) {
+          for (; i + detail::reduceLanes <= n; i += detail::reduceLanes) {
+            for (size_t k = 0; k < detail::reduceLanes; ++k) {
+              add(k, static_cast<result_type>(values[i + k]));
+            }
+          }
+          for (size_t k = 0; i < n; ++i, ++k) {
+            add(k, static_cast<result_type>(values[i]));
+          }
+        }
+        else {
+          for (; i + detail::reduceLanes <= n; i += detail::reduceLanes) {
+            for (size_t k = 0; k < detail::reduceLanes; ++k) {
+              _lanes[k] += static_cast<result_type>(values[i + k]);
+            }
+          }
+          for (size_t k = 0; i < n; ++i, ++k) {
+            _lanes[k] += static_cast<result_type>(values[i]);
+          }
+        }
+      }
+      else {
+        result_type total = 0;
+        for (size_t i = 0; i < n; ++i) {
+          total += static_cast<result_type>(values[i]);
+        }
+        _lanes[0] += total;
+      }
+    }
+
+    result_type value() const {
+      if constexpr (std::is_floating_point_v<result_type>) {
+        if (_method == Summation::Kahan) {
+          result_type total = 0;
+          result_type carry = 0;
+          for (size_t k = 0; k < detail::reduceLanes; ++k) {
+            for (result_type part : { _lanes[k], -_carry[k] }) {
+              result_type y = part - carry;
+              result_type t = total + y;
+              carry = (t - total) - y;
+              total = t;
+            }
+          }
+          return total;
+        }
+        result_type total = 0;
+        for (size_t k = 0; k < detail::reduceLanes; ++k) {
+          total += _lanes[k];
+        }
+        return total;
+      }
+      else {
+        return _lanes[0];
+      }
+    }
+
+  private:
+    void add(size_t k, result_type value) {
+      result_type y = value - _carry[k];
+      result_type t = _lanes[k] + y;
+      _carry[k] = (t - _lanes[k]) - y;
+      _lanes[k] = t;
+    }
+
+    Summation _method;
+    result_type _lanes[detail::reduceLanes]{};
+    result_type _carry[detail::reduceLanes]{};
+  };
+
+  /*========================================================
+   * MinMax
+   *  - smallest and largest values, and how many were seen
+   *  - NaNs are ignored; with no values, min() and max() are
+   *    the type's largest and lowest values
+   */
+  template<typename T>
+  class MinMax {
+    static_assert(std::is_arithmetic_v<T>, "MinMax requires an arithmetic type");
+
+  public:
+    void operator ()(T const* values, size_t n) {
+      T lo = _min;
+      T hi = _max;
+      for (size_t i = 0; i < n; ++i) {
+        lo = values[i] < lo ? values[i] : lo;
+        hi = values[i] > hi ? values[i] : hi;
+      }
+      _min = lo;
+      _max = hi;
+      _count += n;
+    }
+
+    T min() const {
+      return _min;
+    }
+
+    T max() const {
+      return _max;
+    }
+
+    size_t count() const {
+      return _count;
+    }
+
+  private:
+    T _min = std::numeric_limits<T>::max();
+    T _max = std::numeric_limits<T>::lowest();
+    size_t _count = 0;
+  };
+
+  /*========================================================
+   * Moments
+   *  - count, mean and variance, in double
+   *  - each block is reduced in two passes (mean, then
+   *    squared deviations) while it is in cache, and merged
+   *    into the running totals with Chan's update, which
+   *    avoids the cancellation of a sum of squares
+   */
+  class Moments {
+  public:
+    template<typename T>
+    void operator ()(T const* values, size_t n) {
+      static_assert(std::is_arithmetic_v<T>, "Moments requires an arithmetic type");
+      if (n == 0) {
+        return;
+      }
+      double lanes[detail::reduceLanes]{};
+      size_t i = 0;
+      for (; i + detail::reduceLanes <= n; i += detail::reduceLanes) {
+        for (size_t k = 0; k < detail::reduceLanes; ++k) {
+          lanes[k] += static_cast<double>(values[i + k]);
+        }
+      }
+      for (size_t k = 0; i < n; ++i, ++k) {
+        lanes[k] += static_cast<double>(values[i]);
+      }
+      double mean = 0;
+      for (double lane : lanes) {
+        mean += lane;
+      }
+      mean /= static_cast<double>(n);
+
+      std::fill(std::begin(lanes), std::end(lanes), 0.0);
+      for (i = 0; i + detail::reduceLanes <= n; i += detail::reduceLanes) {
+        for (size_t k = 0; k < detail::reduceLanes; ++k) {
+          double d = static_cast<double>(values[i + k]) - mean;
+          lanes[k] += d * d;
+        }
+      }
+      for (size_t k = 0; i < n; ++i, ++k) {
+        double d = static_cast<double>(values[i]) - mean;
+        lanes[k] += d * d;
+      }
+      double m2 = 0;
+      for (double lane : lanes) {
+        m2 += lane;
+      }
+
+      merge(n, mean, m2);
+    }
+
+    // Combine with moments of other values (e.g. another chunk)
+    void merge(Moments const& other) {
+      if (other._count) {
+        merge(other._count, other._mean, other._m2);
+      }
+    }
+
+    size_t count() const {
+      return _count;
+    }
+
+    double mean() const {
+      return _mean;
+    }
+
+    // Population variance (divides by count)
+    double variance() const {
+      return _count ? _m2 / static_cast<double>(_count) : 0.0;
+    }
+
+    // Sample variance (divides by count - 1)
+    double sampleVariance() const {
+      return _count > 1 ? _m2 / static_cast<double>(_count - 1) : 0.0;
+    }
+
+    double stddev() const {
+      return std::sqrt(variance());
+    }
+
+  private:
+    void merge(size_t n, double mean, double m2) {
+      size_t total = _count + n;
+      double delta = mean - _mean;
+      double weight = static_cast<double>(n) / static_cast<double>(total);
+      _mean += delta * weight;
+      _m2 += m2 + delta * delta * static_cast<double>(_count) * weight;
+      _count = total;
+    }
+
+    size_t _count = 0;
+    double _mean = 0;
+    double _m2 = 0;
+  };
+
+  /*========================================================
+   * Histogram
+   *  - bins (at least one) of equal width over [lo, hi),
+   *    which must not be empty; values outside
+   *    the range are counted by under() and over() (NaN
+   *    counts as over)
+   */
+  class Histogram {
+  public:
+    Histogram(double lo, double hi, size_t bins)
+      : _lo{ lo }, _hi{ hi }, _counts(std::max<size_t>(1, bins)) {
+      _scale = static_cast<double>(_counts.size()) / (hi - lo);
+    }
+
+    template<typename T>
+    void operator ()(T const* values, size_t n) {
+      static_assert(std::is_arithmetic_v<T>, "Histogram requires an arithmetic type");
+      size_t last = _counts.size() - 1;
+      for (size_t i = 0; i < n; ++i) {
+        double x = static_cast<double>(values[i]);
+        if (x < _lo) {
+          ++_under;
+        }
+        else if (!(x < _hi)) {
+          ++_over;
+        }
+        else {
+          // rounding can put a value just below hi one past the end
+          ++_counts[std::min(static_cast<size_t>((x - _lo) * _scale), last)];
+        }
+      }
+    }
+
+    double lo() const {
+      return _lo;
+    }
+
+    double hi() const {
+      return _hi;
+    }
+
+    std::vector<size_t> const& counts() const {
+      return _counts;
+    }
+
+    size_t under() const {
+      return _under;
+    }
+
+    size_t over() const {
+      return _over;
+    }
+
+  private:
+    double _lo;
+    double _hi;
+    std::vector<size_t> _counts;
+    double _scale;
+    size_t _under = 0;
+    size_t _over = 0;
+  };
+
+  /*========================================================
+   * Single-accumulator shorthands
+   */
+
+  // sum<Acc>(begin, end) sums in Acc (see Sum)
+  template<typename Acc = void, typename It> inline
+  auto sum(It begin, It end, Summation method = Summation::Plain) {
+    using T = typename std::iterator_traits<It>::value_type;
+    Sum<T, std::conditional_t<std::is_void_v<Acc>, detail::SumType<T>, Acc>> acc(method);
+    cgf::reduce(std::move(begin), std::move(end), acc);
+    return acc.value();
+  }
+
+  template<typename It> inline
+  MinMax<typename std::iterator_traits<It>::value_type> minMax(It begin, It end) {
+    MinMax<typename std::iterator_traits<It>::value_type> acc;
+    cgf::reduce(std::move(begin), std::move(end), acc);
+    return acc;
+  }
+
+  template<typename It> inline
+  Moments moments(It begin, It end) {
+    Moments acc;
+    cgf::reduce(std::move(begin), std::move(end), acc);
+    return acc;
+  }
+
+  template<typename It> inline
+  Histogram histogram(It begin, It end, double lo, double hi, size_t bins) {
+    Histogram acc(lo, hi, bins);
+    cgf::reduce(std::move(begin), std::move(end), acc);
+    return acc;
+  }
+
+}
@@ -0,0 +1,450 @@
+// Copyright 2023, Gabriel Foust, All rights reserved
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if !defined(CGF_NO_SIMD) && (defined(__x86_64__) || defined(_M_X64))
+#define CGF_SIMD_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define CGF_TARGET_AVX2
+#else
+#define CGF_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#elif !defined(CGF_NO_SIMD) && (defined(__aarch64__) || defined(_M_ARM64))
+#define CGF_SIMD_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace cgf {
+  namespace detail {
+    namespace simd {
+
+      /*------------------------------------------------------
+       * Bit helpers
+       */
+      inline
+      unsigned countTrailingZeros(uint64_t bits) {
+#if defined(_MSC_VER) && !defined(__clang__)
+        unsigned long index;
+        _BitScanForward64(&index, bits);
+        return static_cast<unsigned>(index);
+#else
+        return static_cast<unsigned>(__builtin_ctzll(bits));
+#endif
+      }
+
+      inline
+      unsigned popCount(uint64_t bits) {
+#if defined(_MSC_VER) && !defined(__clang__)
+        return static_cast<unsigned>(__popcnt64(bits));
+#else
+        return static_cast<unsigned>(__builtin_popcountll(bits));
+#endif
+      }
+
+      // Offset of the kth (from 1) set bit of bits, which has at least k
+      inline
+      unsigned selectBit(uint64_t bits, size_t k) {
+        for (; k > 1; --k) {
+          bits &= bits - 1;
+        }
+        return countTrailingZeros(bits);
+      }
+
+      /*------------------------------------------------------
+       * Scalar kernel
+       *  - whitespace is ' ' and '\t' through '\r'
+       *  - each function returns the offset of the first byte
+       *    that is (findSpace) or is not (skipSpace) whitespace,
+       *    or n if there is none
+       *  - skipTokens steps over tokens without looking inside
+       *    them: it counts token ends (whitespace just after a
+       *    token) down from tokens, which must be nonzero, and
+       *    returns the offset of the end that reaches zero, or n;
+       *    inToken carries whether the previous byte was part of
+       *    a token from one call to the next
+       */
+      namespace scalar {
+        inline
+        bool isSpace(char c) {
+          return c == ' ' || static_cast<unsigned char>(c - '\t') <= '\r' - '\t';
+        }
+
+        inline
+        size_t findSpace(char const* p, size_t n) {
+          size_t i = 0;
+          while (i != n && !isSpace(p[i])) {
+            ++i;
+          }
+          return i;
+        }
+
+        inline
+        size_t skipSpace(char const* p, size_t n) {
+          size_t i = 0;
+          while (i != n && isSpace(p[i])) {
+            ++i;
+          }
+          return i;
+        }
+
+        // First of a, b or c (a delimiter search)
+        inline
+        size_t findAny(char const* p, size_t n, char a, char b, char c) {
+          size_t i = 0;
+          while (i != n && p[i] != a && p[i] != b && p[i] != c) {
+            ++i;
+          }
+          return i;
+        }
+
+        inline
+        size_t skipTokens(char const* p, size_t n, size_t& tokens, bool& inToken) {
+          for (size_t i = 0; i != n; ++i) {
+            bool space = isSpace(p[i]);
+            if (space && inToken && --tokens == 0) {
+              inToken = false;
+              return i;
+            }
+            inToken = !space;
+          }
+          return n;
+        }
+      }
+
+#if defined(CGF_SIMD_X86)
+      /*------------------------------------------------------
+       * SSE2 kernel (baseline on x86-64), 16 bytes per step
+       */
+      namespace sse2 {
+        inline
+        unsigned spaceMask(char const* p) {
+          __m128i v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(p));
+          __m128i blank = _mm_cmpeq_epi8(v, _mm_set1_epi8(' '));
+          __m128i t = _mm_sub_epi8(v, _mm_set1_epi8('\t'));
+          __m128i ctrl = _mm_cmpeq_epi8(_mm_min_epu8(t, _mm_set1_epi8('\r' - '\t')), t);
+          return static_cast<unsigned>(_mm_movemask_epi8(_mm_or_si128(blank, ctrl)));
+        }
+
+        inline
+        size_t findSpace(char const* p, size_t n) {
+          size_t i = 0;
+          for (; i + 16 <= n; i += 16) {
+            if (unsigned mask = spaceMask(p + i)) {
+              return i + countTrailingZeros(mask);
+            }
+          }
+          return i + scalar::findSpace(p + i, n - i);
+        }
+
+        inline
+        size_t skipSpace(char const* p, size_t n) {
+          size_t i = 0;
+          for (; i + 16 <= n; i += 16) {
+            if (unsigned mask = ~spaceMask(p + i) & 0xFFFFu) {
+              return i + countTrailingZeros(mask);
+            }
+          }
+          return i + scalar::skipSpace(p + i, n - i);
+        }
+
+        inline
+        size_t findAny(char const* p, size_t n, char a, char b, char c) {
+          __m128i va = _mm_set1_epi8(a);
+          __m128i vb = _mm_set1_epi8(b);
+          __m128i vc = _mm_set1_epi8(c);
+          size_t i = 0;
+          for (; i + 16 <= n; i += 16) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(p + i));
+            __m128i hit = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, va), _mm_cmpeq_epi8(v, vb)), _mm_cmpeq_epi8(v, vc));
+            if (unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(hit))) {
+              return i + countTrailingZeros(mask);
+            }
+          }
+          return i + scalar::findAny(p + i, n - i, a, b, c);
+        }
+
+        inline
+        size_t skipTokens(char const* p, size_t n, size_t& tokens, bool& inToken) {
+          size_t i = 0;
+          for (; i + 16 <= n; i += 16) {
+            unsigned space = spaceMask(p + i);
+            unsigned ends = space & ~(space << 1 | (inToken ? 0u : 1u));
+            size_t count = popCount(ends);
+            if (count >= tokens) {
+              unsigned end = selectBit(ends, tokens);
+              tokens = 0;
+              inToken = false;
+              return i + end;
+            }
+            tokens -= count;
+            inToken = !(space >> 15);
+          }
+          return i + scalar::skipTokens(p + i, n - i, tokens, inToken);
+        }
+      }
+
+      /*------------------------------------------------------
+       * AVX2 kernel, 32 bytes per step (selected at runtime)
+       */
+      namespace avx2 {
+        CGF_TARGET_AVX2 inline
+        uint32_t spaceMask(char const* p) {
+          __m256i v = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(p));
+          __m256i blank = _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' '));
+          __m256i t = _mm256_sub_epi8(v, _mm256_set1_epi8('\t'));
+          __m256i ctrl = _mm256_cmpeq_epi8(_mm256_min_epu8(t, _mm256_set1_epi8('\r' - '\t')), t);
+          return static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_or_si256(blank, ctrl)));
+        }
+
+        CGF_TARGET_AVX2 inline
+        size_t findSpace(char const* p, size_t n) {
+          size_t i = 0;
+          for (; i + 32 <= n; i += 32) {
+            if (uint32_t mask = spaceMask(p + i)) {
+              return i + countTrailingZeros(mask);
+            }
+          }
+          return i + sse2::findSpace(p + i, n - i);
+        }
+
+        CGF_TARGET_AVX2 inline
+        size_t skipSpace(char const* p, size_t n) {
+          size_t i = 0;
+          for (; i + 32 <= n; i += 32) {
+            if (uint32_t mask = ~spaceMask(p + i)) {
+              return i + countTrailingZeros(mask);
+            }
+          }
+          return i + sse2::skipSpace(p + i, n - i);
+        }
+
+        CGF_TARGET_AVX2 inline
+        size_t findAny(char const* p, size_t n, char a, char b, char c) {
+          __m256i va = _mm256_set1_epi8(a);
+          __m256i vb = _mm256_set1_epi8(b);
+          __m256i vc = _mm256_set1_epi8(c);
+          size_t i = 0;
+          for (; i + 32 <= n; i += 32) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(p + i));
+            __m256i hit = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, va), _mm256_cmpeq_epi8(v, vb)),
+                                          _mm256_cmpeq_epi8(v, vc));
+            if (uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(hit))) {
+              return i + countTrailingZeros(mask);
+            }
+          }
+          return i + sse2::findAny(p + i, n - i, a, b, c);
+        }
+
+        CGF_TARGET_AVX2 inline
+        size_t skipTokens(char const* p, size_t n, size_t& tokens, bool& inToken) {
+          size_t i = 0;
+          for (; i + 32 <= n; i += 32) {
+            uint32_t space = spaceMask(p + i);
+            uint32_t ends = space & ~(space << 1 | (inToken ? 0u : 1u));
+            size_t count = popCount(ends);
+            if (count >= tokens) {
+              unsigned end = selectBit(ends, tokens);
+              tokens = 0;
+              inToken = false;
+              return i + end;
+            }
+            tokens -= count;
+            inToken = !(space >> 31);
+          }
+          return i + sse2::skipTokens(p + i, n - i, tokens, inToken);
+        }
+
+        inline
+        bool supported() {
+#if defined(_MSC_VER) && !defined(__clang__)
+          int info[4];
+          __cpuid(info, 0);
+          if (info[0] < 7) {
+            return false;
+          }
+          __cpuid(info, 1);
+          bool osxsave = (info[2] & (1 << 27)) != 0;
+          if (!osxsave || (_xgetbv(0) & 6) != 6) {
+            return false;
+          }
+          __cpuidex(info, 7, 0);
+          return (info[1] & (1 << 5)) != 0;
+#else
+          return __builtin_cpu_supports("avx2");
+#endif
+        }
+      }
+#endif
+
+#if defined(CGF_SIMD_NEON)
+      /*------------------------------------------------------
+       * NEON kernel, 16 bytes per step
+       *  - there is no movemask; narrowing by 4 bits leaves one
+       *    nibble per byte in a 64-bit lane
+       */
+      namespace neon {
+        inline
+        uint64_t spaceMask(char const* p) {
+          uint8x16_t v = vld1q_u8(reinterpret_cast<uint8_t const*>(p));
+          uint8x16_t blank = vceqq_u8(v, vdupq_n_u8(' '));
+          uint8x16_t ctrl = vcleq_u8(vsubq_u8(v, vdupq_n_u8('\t')), vdupq_n_u8('\r' - '\t'));
+          uint8x8_t nibbles = vshrn_n_u16(vreinterpretq_u16_u8(vorrq_u8(blank, ctrl)), 4);
+          return vget_lane_u64(vreinterpret_u64_u8(nibbles), 0);
+        }
+
+        inline
+        size_t findSpace(char const* p, size_t n) {
+          size_t i = 0;
+          for (; i + 16 <= n; i += 16) {
+            if (uint64_t mask = spaceMask(p + i)) {
+              return i + countTrailingZeros(mask) / 4;
+            }
+          }
+          return i + scalar::findSpace(p + i, n - i);
+        }
+
+        inline
+        size_t skipSpace(char const* p, size_t n) {
+          size_t i = 0;
+          for (; i + 16 <= n; i += 16) {
+            if (uint64_t mask = ~spaceMask(p + i)) {
+              return i + countTrailingZeros(mask) / 4;
+            }
+          }
+          return i + scalar::skipSpace(p + i, n - i);
+        }
+
+        inline
+        size_t findAny(char const* p, size_t n, char a, char b, char c) {
+          uint8x16_t va = vdupq_n_u8(static_cast<uint8_t>(a));
+          uint8x16_t vb = vdupq_n_u8(static_cast<uint8_t>(b));
+          uint8x16_t vc = vdupq_n_u8(static_cast<uint8_t>(c));
+          size_t i = 0;
+          for (; i + 16 <= n; i += 16) {
+            uint8x16_t v = vld1q_u8(reinterpret_cast<uint8_t const*>(p + i));
+            uint8x16_t hit = vorrq_u8(vorrq_u8(vceqq_u8(v, va), vceqq_u8(v, vb)), vceqq_u8(v, vc));
+            uint8x8_t nibbles = vshrn_n_u16(vreinterpretq_u16_u8(hit), 4);
+            if (uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(nibbles), 0)) {
+              return i + countTrailingZeros(mask) / 4;
+            }
+          }
+          return i + scalar::findAny(p + i, n - i, a, b, c);
+        }
+
+        // Each byte is a nibble of the mask, so a token end is
+        // four set bits
+        inline
+        size_t skipTokens(char const* p, size_t n, size_t& tokens, bool& inToken) {
+          size_t i = 0;
+          for (; i + 16 <= n; i += 16) {
+            uint64_t space = spaceMask(p + i);
+            uint64_t ends = space & ~(space << 4 | (inToken ? 0u : 0xFu));
+            size_t count = popCount(ends) / 4;
+            if (count >= tokens) {
+              for (; tokens > 1; --tokens) {
+                ends &= ~(uint64_t(0xF) << (countTrailingZeros(ends) & ~3u));
+              }
+              tokens = 0;
+              inToken = false;
+              return i + countTrailingZeros(ends) / 4;
+            }
+            tokens -= count;
+            inToken = !(space >> 63);
+          }
+          return i + scalar::skipTokens(p + i, n - i, tokens, inToken);
+        }
+      }
+#endif
+
+      /*------------------------------------------------------
+       * Runtime kernel selection
+       */
+      struct Kernel {
+        size_t (*findSpace)(char const*, size_t);
+        size_t (*skipSpace)(char const*, size_t);
+        size_t (*findAny)(char const*, size_t, char, char, char);
+        size_t (*skipTokens)(char const*, size_t, size_t&, bool&);
+      };
+
+      inline
+      Kernel selectKernel() {
+#if defined(CGF_SIMD_X86)
+        if (avx2::supported()) {
+          return { avx2::findSpace, avx2::skipSpace, avx2::findAny, avx2::skipTokens };
+        }
+        return { sse2::findSpace, sse2::skipSpace, sse2::findAny, sse2::skipTokens };
+#elif defined(CGF_SIMD_NEON)
+        return { neon::findSpace, neon::skipSpace, neon::findAny, neon::skipTokens };
+#else
+        return { scalar::findSpace, scalar::skipSpace, scalar::findAny, scalar::skipTokens };
+#endif
+      }
+
+      inline
+      Kernel const& kernel() {
+        static Kernel const selected = selectKernel();
+        return selected;
+      }
+
+      /*------------------------------------------------------
+       * Eight digits at a time (SWAR)
+       *  - eightDigits checks that all eight bytes are '0'-'9'
+       *  - parseEight converts them, most significant first
+       */
+      inline
+      uint64_t load8(char const* p) {
+        uint64_t word;
+        std::memcpy(&word, p, sizeof word);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        word = __builtin_bswap64(word);
+#endif
+        return word;
+      }
+
+      inline
+      bool eightDigits(uint64_t word) {
+        return ((word & 0xF0F0F0F0F0F0F0F0)
+                | (((word + 0x0606060606060606) & 0xF0F0F0F0F0F0F0F0) >> 4))
+               == 0x3333333333333333;
+      }
+
+      inline
+      uint32_t parseEight(uint64_t word) {
+        word = (word & 0x0F0F0F0F0F0F0F0F) * 2561 >> 8;
+        word = (word & 0x00FF00FF00FF00FF) * 6553601 >> 16;
+        return static_cast<uint32_t>((word & 0x0000FFFF0000FFFF) * 42949672960001 >> 32);
+      }
+
+      /*------------------------------------------------------
+       * Decimal digits to an unsigned accumulator
+       *  - at most 19 digits, so the result cannot overflow
+       *  - returns false if any character is not a digit
+       */
+      inline
+      bool parseDigits(char const* first, char const* last, uint64_t& value) {
+        uint64_t acc = 0;
+        for (; last - first >= 8; first += 8) {
+          uint64_t word = load8(first);
+          if (!eightDigits(word)) {
+            return false;
+          }
+          acc = acc * 100000000 + parseEight(word);
+        }
+        for (; first != last; ++first) {
+          unsigned digit = static_cast<unsigned char>(*first - '0');
+          if (digit > 9) {
+            return false;
+          }
+          acc = acc * 10 + digit;
+        }
+        value = acc;
+        return true;
+      }
+
+    }
+  }
+}
@@ -0,0 +1,909 @@
+// Copyright 2023, Gabriel Foust, All rights reserved
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <istream>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include "delimited.hpp"
+#include "errors.hpp"
+#include "fields.hpp"
+#include "parse.hpp"
+#include "stats.hpp"
+
+namespace cgf {
+  namespace detail {
+
+    /*========================================================
+     * Input states shared by the iterator types
+     */
+
+    // State of an iterator being used for input
+    //  - values are read into buffer if one is bound, else value
+    //  - Stats is an empty base unless statistics are collected
+    //  - bad input is skipped and recorded in errors if a sink
+    //    is bound, instead of failing
+    //  - integers in text are written in format (in all three
+    //    states, where it trails so it can be left out)
+    //  - bytesRead counts what the reads consumed, which is
+    //    the position of a stream that cannot report its own
+    //    (see offset)
+    template<typename T, typename Stats = NoStats>
+    struct InputState : Stats {
+      std::istream* in;
+      mutable bool valid;
+      mutable T value;
+      ParseMode mode;
+      T* buffer;
+      ErrorSink* errors;
+      NumberFormat format{};
+      mutable size_t bytesRead = 0;
+    };
+
+    // Values that are their token's bytes, so a sentinel can be
+    // found by searching for its bytes
+    template<typename T>
+    inline constexpr bool isSearchable = isString<T> || std::is_same_v<T, std::string_view>;
+
+    // Where a memory source's next sentinel is (see
+    // sentinelBoundary)
+    //  - found in [from, last) by a search for pattern; at is
+    //    the start of the sentinel token, or null if none was
+    //    found, and before is just past the token before it
+    struct SentinelScan {
+      std::string pattern;
+      char const* from = nullptr;
+      char const* at = nullptr;
+      char const* before = nullptr;
+    };
+
+    struct NoSentinelScan {
+    };
+
+    // State of an iterator reading from memory (e.g. a MappedFile)
+    //  - mirrors the stream's eof and fail bits, except that eof
+    //    is only set once no token remains, so a final token
+    //    without trailing whitespace is not lost
+    //  - values that are searchable remember the last sentinel
+    //    search
+    template<typename T, typename Stats = NoStats>
+    struct MappedState : Stats {
+      char const* first;
+      mutable char const* next;
+      char const* last;
+      mutable bool valid;
+      mutable bool eof;
+      mutable bool fail;
+      mutable T value;
+      T* buffer;
+      ErrorSink* errors;
+      NumberFormat format{};
+      mutable std::conditional_t<isSearchable<T>, SentinelScan, NoSentinelScan> sentinelScan{};
+    };
+
+    // State of an iterator reading a delimited source in memory
+    //  - yields a Record per record, or else a value per field
+    //  - recordStart is set between records; blank records are
+    //    skipped there
+    template<typename T, typename Stats = NoStats>
+    struct DelimitedState : Stats {
+      char const* first;
+      mutable char const* next;
+      char const* last;
+      mutable bool valid;
+      mutable bool eof;
+      mutable bool fail;
+      mutable bool recordStart;
+      mutable T value;
+      T* buffer;
+      Dialect dialect;
+      ErrorSink* errors;
+      NumberFormat format{};
+    };
+
+    // A state that also counts the values read, for iterators
+    // that stop after a runtime count
+    template<typename State>
+    struct Counted : State {
+      size_t count = 0;
+    };
+
+    template<typename S>
+    struct IsState : std::false_type {};
+
+    template<typename T, typename Stats>
+    struct IsState<InputState<T, Stats>> : std::true_type {};
+
+    template<typename T, typename Stats>
+    struct IsState<MappedState<T, Stats>> : std::true_type {};
+
+    template<typename T, typename Stats>
+    struct IsState<DelimitedState<T, Stats>> : std::true_type {};
+
+    template<typename S>
+    struct IsState<Counted<S>> : IsState<S> {};
+
+    template<typename S>
+    inline constexpr bool isState = IsState<S>::value;
+
+    // Whether value is a sentinel; untilSentinel requires
+    // operator ==, so only an end iterator that cannot stop at
+    // a sentinel reaches the false branch
+    template<typename T, typename = void>
+    inline constexpr bool isEqualityComparable = false;
+
+    template<typename T>
+    inline constexpr bool isEqualityComparable<T, std::void_t<decltype(std::declval<T const&>() == std::declval<T const&>())>> =
+      true;
+
+    template<typename T>
+    bool matches(T const& value, T const& sentinel) {
+      if constexpr (isEqualityComparable<T>) {
+        return static_cast<bool>(value == sentinel);
+      }
+      else {
+        return false;
+      }
+    }
+
+    /*------------------------------------------------------
+     * Reading
+     */
+
+    // Where the current value lives
+    template<typename State>
+    auto& slot(State const& state) {
+      return state.buffer ? *state.buffer : state.value;
+    }
+
+    // Whether text is read by the buffered token parser rather
+    // than operator >> (string_view, formatted integers and
+    // field records always are)
+    template<typename T, typename S>
+    bool readsTokens(InputState<T, S> const& state) {
+      if constexpr (std::is_same_v<T, std::string_view> || isFieldRecord<T>) {
+        return true;
+      }
+      else if constexpr (hasTokenParser<T>) {
+        return state.mode == ParseMode::Buffered || !state.format.isDecimal();
+      }
+      else {
+        return false;
+      }
+    }
+
+    // Read one field of a record from a stream: with the token
+    // parser if its type has one, whatever the mode, else with
+    // operator >>
+    template<typename F>
+    bool extractField(std::istream& in, F& field, NumberFormat format, size_t& consumed) {
+      static_assert(!isFieldRecord<F>, "record fields cannot be records");
+      if constexpr (hasTokenParser<F>) {
+        extract(in, field, consumed, format);
+      }
+      else if constexpr (isExtractable<F>) {
+        in >> field;
+      }
+      else {
+        in.setstate(std::ios_base::failbit);
+      }
+      return !in.fail();
+    }
+
+    // Read a field record from a stream, one token per field
+    //  - input that ends inside a record ends iteration, as it
+    //    does inside a value read with operator >>
+    //  - after a bad field, the record's remaining tokens are
+    //    stepped over, so a skipped record leaves the stream at
+    //    the next one
+    template<typename T, typename S>
+    void readFields(InputState<T, S> const& state, T& value, size_t& consumed) {
+      std::istream& in = *state.in;
+      size_t read = 0;
+      detail::forEachField(value, [&](auto& field) {
+        ++read;
+        return extractField(in, field, state.format, consumed);
+      });
+      size_t remaining = fieldCount<T>() - read;
+      if (in.fail() && !in.eof() && !in.bad() && remaining) {
+        in.clear();
+        skipTokens(in, remaining, consumed);
+        in.setstate(std::ios_base::failbit);
+      }
+    }
+
+    // Read the next value using the selected parse mode
+    //  - strings are refilled in place, reusing their capacity
+    //  - consumed counts bytes read by the buffered parser and
+    //    binary records only; operator >> does not report them
+    //  - a type without operator >> (e.g. a binary record
+    //    struct) can only be read in a binary mode
+    template<typename T, typename S>
+    void read(InputState<T, S> const& state, T& value, size_t& consumed) {
+      if (isBinary(state.mode)) {
+        readRecords(*state.in, &value, 1, isSwapped(state.mode), consumed);
+      }
+      else if constexpr (isFieldRecord<T>) {
+        readFields(state, value, consumed);
+      }
+      else if (readsTokens(state)) {
+        extract(*state.in, value, consumed, state.format);
+      }
+      else {
+        if constexpr (isExtractable<T>) {
+          *state.in >> value;
+        }
+        else {
+          state.in->setstate(std::ios_base::failbit);
+        }
+      }
+    }
+
+    // Read a field record in memory, one token per field
+    //  - input that ends inside a record fails, but is not eof
+    //    until the next read
+    //  - after a bad field, the record's remaining tokens are
+    //    stepped over
+    template<typename T, typename S>
+    void readFields(MappedState<T, S> const& state, T& value, size_t& consumed) {
+      size_t read = 0;
+      char const* start = state.next;
+      bool converted = detail::forEachField(value, [&](auto& field) {
+        static_assert(!isFieldRecord<std::remove_reference_t<decltype(field)>>, "record fields cannot be records");
+        char const* first = skipSpace(state.next, state.last);
+        if (first == state.last) {
+          state.next = first;
+          state.eof = read == 0;
+          return false;
+        }
+        ++read;
+        state.next = findSpace(first, state.last);
+        return parseToken(std::string_view(first, static_cast<size_t>(state.next - first)), field, state.format);
+      });
+      if (!converted) {
+        state.fail = true;
+        size_t remaining = fieldCount<T>() - read;
+        state.next = skipTokens(state.next, state.last, remaining);
+      }
+      consumed += static_cast<size_t>(state.next - start);
+    }
+
+    // Read the next token in memory
+    template<typename T, typename S>
+    void read(MappedState<T, S> const& state, T& value, size_t& consumed) {
+      if constexpr (isFieldRecord<T>) {
+        readFields(state, value, consumed);
+        return;
+      }
+      char const* first = skipSpace(state.next, state.last);
+      if (first == state.last) {
+        consumed += static_cast<size_t>(first - state.next);
+        state.next = first;
+        state.eof = state.fail = true;
+        return;
+      }
+      char const* last = findSpace(first, state.last);
+      consumed += static_cast<size_t>(last - state.next);
+      state.next = last;
+      std::string_view token(first, static_cast<size_t>(last - first));
+      if (!parseToken(token, value, state.format)) {
+        state.fail = true;
+      }
+    }
+
+    // Step over the next record (if T is Record) or field
+    //  - text is the record, or the field without its quotes;
+    //    escaped is set if it still contains doubled quotes
+    //  - returns false, setting eof and fail, if none remains
+    template<typename T, typename S>
+    bool nextItem(DelimitedState<T, S> const& state, std::string_view& text, bool& escaped, size_t& consumed) {
+      char const* start = state.next;
+      char const* first = start;
+      Dialect const& dialect = state.dialect;
+      if (state.recordStart) {
+        while (first != state.last && isBlank(*first, dialect)) {
+          ++first;
+        }
+        if (first == state.last) {
+          consumed += static_cast<size_t>(first - start);
+          state.next = first;
+          state.eof = state.fail = true;
+          return false;
+        }
+      }
+      char const* end;
+      if constexpr (std::is_same_v<T, Record>) {
+        end = findRecordEnd(first, state.last, dialect);
+        text = trimReturn(first, end, dialect);
+        escaped = false;
+      }
+      else {
+        end = splitField(first, state.last, dialect, text, escaped);
+      }
+      state.recordStart = end == state.last || *end == dialect.record;
+      state.next = end == state.last ? end : end + 1;
+      consumed += static_cast<size_t>(state.next - start);
+      return true;
+    }
+
+    // Read a field record from one delimited record
+    //  - fields beyond the record's are skipped; a record with
+    //    too few fails
+    template<typename T, typename S>
+    void readFields(DelimitedState<T, S> const& state, T& value, size_t& consumed) {
+      std::string_view text;
+      bool escaped;
+      bool first = true;
+      bool converted = detail::forEachField(value, [&](auto& field) {
+        static_assert(!isFieldRecord<std::remove_reference_t<decltype(field)>>, "record fields cannot be records");
+        if ((!first && state.recordStart) || !nextItem(state, text, escaped, consumed)) {
+          return false;
+        }
+        first = false;
+        return parseField(text, escaped, state.dialect, field, state.format);
+      });
+      if (state.eof) {
+        return;
+      }
+      if (!state.recordStart) {
+        char const* end = findRecordEnd(state.next, state.last, state.dialect);
+        end = end == state.last ? end : end + 1;
+        consumed += static_cast<size_t>(end - state.next);
+        state.next = end;
+        state.recordStart = true;
+      }
+      if (!converted) {
+        state.fail = true;
+      }
+    }
+
+    // Read the next record or field
+    template<typename T, typename S>
+    void read(DelimitedState<T, S> const& state, T& value, size_t& consumed) {
+      if constexpr (isFieldRecord<T>) {
+        readFields(state, value, consumed);
+        return;
+      }
+      std::string_view text;
+      bool escaped;
+      if (!nextItem(state, text, escaped, consumed)) {
+        return;
+      }
+      if constexpr (std::is_same_v<T, Record>) {
+        value = Record(text, state.dialect);
+      }
+      else if (!parseField(text, escaped, state.dialect, value, state.format)) {
+        state.fail = true;
+      }
+    }
+
+    template<typename T, typename S>
+    bool failed(InputState<T, S> const& state) {
+      return !*state.in;
+    }
+
+    template<typename T, typename S>
+    bool failed(MappedState<T, S> const& state) {
+      return state.fail;
+    }
+
+    template<typename T, typename S>
+    bool failed(DelimitedState<T, S> const& state) {
+      return state.fail;
+    }
+
+    template<typename T, typename S>
+    bool atEof(InputState<T, S> const& state) {
+      return state.in->eof();
+    }
+
+    template<typename T, typename S>
+    bool atEof(MappedState<T, S> const& state) {
+      return state.eof;
+    }
+
+    template<typename T, typename S>
+    bool atEof(DelimitedState<T, S> const& state) {
+      return state.eof;
+    }
+
+    // Whether two states read from the same source
+    template<typename T, typename S>
+    bool sameSource(InputState<T, S> const& lhs, InputState<T, S> const& rhs) {
+      return lhs.in == rhs.in;
+    }
+
+    template<typename T, typename S>
+    bool sameSource(MappedState<T, S> const& lhs, MappedState<T, S> const& rhs) {
+      return lhs.last == rhs.last;
+    }
+
+    template<typename T, typename S>
+    bool sameSource(DelimitedState<T, S> const& lhs, DelimitedState<T, S> const& rhs) {
+      return lhs.last == rhs.last;
+    }
+
+    /*------------------------------------------------------
+     * Stream position
+     *  - a stream's own position if it can report one (a file
+     *    or string stream), else bytesRead, the bytes consumed
+     *    since the iterator was created (a pipe or socket)
+     *  - bytesRead is exact for the token parser and binary
+     *    records but operator >> does not report what it
+     *    reads, so values read with it leave the position
+     *    unknown
+     */
+
+    template<typename... Fs>
+    constexpr bool parsesTokens(std::tuple<Fs...> const*) {
+      return (hasTokenParser<Fs> && ...);
+    }
+
+    template<typename T, typename... Ms>
+    constexpr bool parsesTokens(std::tuple<Ms T::*...> const*) {
+      return (hasTokenParser<Ms> && ...);
+    }
+
+    // Whether every byte a read consumes is counted
+    template<typename T, typename S>
+    bool countsBytes(InputState<T, S> const& state) {
+      if (isBinary(state.mode)) {
+        return true;
+      }
+      else if constexpr (isTuple<T>) {
+        return parsesTokens(static_cast<T const*>(nullptr));
+      }
+      else if constexpr (hasFields<T>) {
+        return parsesTokens(static_cast<std::remove_cv_t<decltype(Fields<T>::members)> const*>(nullptr));
+      }
+      else {
+        return readsTokens(state);
+      }
+    }
+
+    // Where the stream stands, with pending bytes consumed but
+    // not yet added to bytesRead
+    template<typename T, typename S>
+    size_t streamOffset(InputState<T, S> const& state, size_t pending = 0) {
+      auto pos = state.in->rdbuf()->pubseekoff(0, std::ios_base::cur, std::ios_base::in);
+      if (pos >= 0) {
+        return static_cast<size_t>(pos);
+      }
+      return countsBytes(state) ? state.bytesRead + pending : ScanError::unknown;
+    }
+
+    template<typename T, typename S>
+    void countBytes(InputState<T, S> const& state, size_t consumed) {
+      state.bytesRead += consumed;
+    }
+
+    template<typename T, typename S>
+    void countBytes(MappedState<T, S> const&, size_t) {
+    }
+
+    template<typename T, typename S>
+    void countBytes(DelimitedState<T, S> const&, size_t) {
+    }
+
+    /*------------------------------------------------------
+     * Error recovery
+     *  - with an error sink bound, a read that fails before end
+     *    of input is recorded and skipped, leaving the source
+     *    ready to read on: no exception, and no failbit left
+     *    for the caller to clear
+     *  - stream errors (badbit), and exceptions thrown by the
+     *    streambuf, are not recoverable; they reach the caller
+     *    as they would without a sink
+     */
+
+    template<typename T, typename S>
+    bool skippable(InputState<T, S> const& state) {
+      return state.errors && state.in->fail() && !state.in->eof() && !state.in->bad();
+    }
+
+    template<typename T, typename S>
+    bool skippable(MappedState<T, S> const& state) {
+      return state.errors && state.fail && !state.eof;
+    }
+
+    template<typename T, typename S>
+    bool skippable(DelimitedState<T, S> const& state) {
+      return state.errors && state.fail && !state.eof;
+    }
+
+    // Skip the bad input that failed the last read
+    //  - consumed is what the read in progress has consumed so
+    //    far, not yet added to bytesRead
+    //  - skipping reads from the streambuf, so an exception
+    //    its underflow throws propagates as it would from a read
+    template<typename T, typename S>
+    void skipBad(InputState<T, S> const& state, size_t consumed) {
+      std::istream& in = *state.in;
+      in.clear();
+      if (isBinary(state.mode)) {
+        // only a partial record at the end fails
+        state.errors->record(streamOffset(state, consumed), ErrorReason::Truncated);
+        in.setstate(std::ios_base::eofbit | std::ios_base::failbit);
+        return;
+      }
+      // operator >> may stop partway into the bad token
+      bool moved = readsTokens(state) || skipToken(in);
+      state.errors->record(streamOffset(state, consumed), ErrorReason::Malformed);
+      if (!moved && !in.eof()) {
+        // make progress even if operator >> consumed nothing
+        in.rdbuf()->sbumpc();
+      }
+    }
+
+    template<typename T, typename S>
+    void skipBad(MappedState<T, S> const& state, size_t) noexcept {
+      state.errors->record(static_cast<size_t>(state.next - state.first), ErrorReason::Malformed);
+      state.fail = false;
+    }
+
+    template<typename T, typename S>
+    void skipBad(DelimitedState<T, S> const& state, size_t) noexcept {
+      state.errors->record(static_cast<size_t>(state.next - state.first), ErrorReason::Malformed);
+      state.fail = false;
+    }
+
+    // Read the next value, skipping bad input if the state has
+    // an error sink
+    template<typename State, typename T>
+    void readValue(State const& state, T& value, size_t& consumed) {
+      read(state, value, consumed);
+      while (skippable(state)) {
+        skipBad(state, consumed);
+        read(state, value, consumed);
+      }
+    }
+
+    // Read the next value, recording the read if the state
+    // collects statistics
+    //  - a failure at end of input is not counted as a failure
+    template<typename State, typename T>
+    void fetch(State const& state, T& value) {
+      size_t consumed = 0;
+      if constexpr (State::enabled) {
+        auto start = std::chrono::steady_clock::now();
+        readValue(state, value, consumed);
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        state.recordRead(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed), consumed,
+                         failed(state) && !atEof(state));
+      }
+      else {
+        readValue(state, value, consumed);
+      }
+      countBytes(state, consumed);
+    }
+
+    // Read up to n binary records straight into out with one
+    // read, recording it as a single read
+    template<typename T, typename S>
+    size_t readRecords(InputState<T, S> const& state, T* out, size_t n, size_t& consumed) {
+      size_t got = readRecords(*state.in, out, n, isSwapped(state.mode), consumed);
+      if (skippable(state)) {
+        skipBad(state, consumed);
+      }
+      countBytes(state, consumed);
+      return got;
+    }
+
+    template<typename T, typename S>
+    size_t fetchRecords(InputState<T, S> const& state, T* out, size_t n) {
+      size_t consumed = 0;
+      if constexpr (S::enabled) {
+        auto start = std::chrono::steady_clock::now();
+        size_t got = readRecords(state, out, n, consumed);
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        state.recordRead(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed), consumed,
+                         failed(state) && !atEof(state));
+        return got;
+      }
+      else {
+        return readRecords(state, out, n, consumed);
+      }
+    }
+
+    /*------------------------------------------------------
+     * Committing
+     */
+
+    // Commit to reading the next value
+    template<typename State>
+    void softCommit(State const& state) {
+      if (!state.valid) {
+        fetch(state, slot(state));
+        state.valid = true;
+      }
+    }
+
+    // Commit to reading the next value and throw exception on failure
+    template<typename State>
+    decltype(auto) hardCommit(State const& state) {
+      softCommit(state);
+      if (failed(state)) {
+        throw std::istream::failure("input failure");
+      }
+      return slot(state);
+    }
+
+    // Advance past the current value
+    //  - the number of values read is kept by the iterator, and
+    //    only by iterators that need it
+    template<typename State>
+    void advance(State& state) {
+      hardCommit(state);
+      state.valid = false;
+      state.recordElement();
+    }
+
+    /*------------------------------------------------------
+     * Position
+     *  - offset is in bytes from the start of the source (for
+     *    streams, the stream position), just past the last
+     *    value read; for a stream that cannot report it, the
+     *    bytes read since the iterator was created, or
+     *    ScanError::unknown (see streamOffset)
+     *  - seek moves the source to offset, dropping any value
+     *    already read; a stream that cannot seek fails
+     */
+
+    template<typename T, typename S>
+    size_t offset(InputState<T, S> const& state) {
+      return streamOffset(state);
+    }
+
+    template<typename T, typename S>
+    size_t offset(MappedState<T, S> const& state) {
+      return static_cast<size_t>(state.next - state.first);
+    }
+
+    template<typename T, typename S>
+    size_t offset(DelimitedState<T, S> const& state) {
+      return static_cast<size_t>(state.next - state.first);
+    }
+
+    template<typename T, typename S>
+    void seek(InputState<T, S> const& state, size_t offset) {
+      state.valid = false;
+      state.in->clear();
+      auto pos = state.in->rdbuf()->pubseekpos(static_cast<std::streamoff>(offset), std::ios_base::in);
+      if (pos < 0) {
+        state.in->setstate(std::ios_base::failbit);
+      }
+      else {
+        state.bytesRead = offset;
+      }
+    }
+
+    template<typename T, typename S>
+    void seek(MappedState<T, S> const& state, size_t offset) {
+      state.valid = false;
+      state.next = state.first + std::min(offset, static_cast<size_t>(state.last - state.first));
+      state.eof = state.fail = false;
+    }
+
+    template<typename T, typename S>
+    void seek(DelimitedState<T, S> const& state, size_t offset) {
+      state.valid = false;
+      state.next = state.first + std::min(offset, static_cast<size_t>(state.last - state.first));
+      state.eof = state.fail = false;
+      state.recordStart = state.next == state.first || state.next[-1] == state.dialect.record;
+    }
+
+    /*------------------------------------------------------
+     * Skipping
+     *  - steps over up to n values as n advances would, and
+     *    returns the number skipped (fewer at end of input)
+     *  - text that is made of tokens is only scanned for token
+     *    boundaries, never converted, so a malformed token is
+     *    skipped like any other; binary records are skipped
+     *    unread, and other values are read and dropped
+     *  - adds the bytes consumed to consumed
+     */
+
+    template<typename T, typename S>
+    size_t skipTokens(InputState<T, S> const& state, size_t n, size_t& consumed) {
+      std::istream& in = *state.in;
+      if (!in.good()) {
+        return 0;
+      }
+      if (isBinary(state.mode)) {
+        size_t limit = static_cast<size_t>(std::numeric_limits<std::streamsize>::max()) / sizeof(T);
+        in.ignore(static_cast<std::streamsize>(std::min(n, limit) * sizeof(T)));
+        size_t got = static_cast<size_t>(in.gcount());
+        consumed += got;
+        return got / sizeof(T);
+      }
+      if constexpr (hasTokenParser<T>) {
+        return skipTokens(in, n, consumed);
+      }
+      else {
+        size_t i = 0;
+        for (; i < n; ++i) {
+          readValue(state, slot(state), consumed);
+          if (failed(state)) {
+            break;
+          }
+        }
+        return i;
+      }
+    }
+
+    template<typename T, typename S>
+    size_t skipTokens(MappedState<T, S> const& state, size_t n, size_t& consumed) {
+      if constexpr (isFieldRecord<T>) {
+        // a record is a run of fieldCount tokens
+        constexpr size_t fields = fieldCount<T>();
+        size_t tokens = std::min(n, std::numeric_limits<size_t>::max() / fields) * fields;
+        size_t remaining = tokens;
+        char const* next = skipTokens(state.next, state.last, remaining);
+        consumed += static_cast<size_t>(next - state.next);
+        state.next = next;
+        return (tokens - remaining) / fields;
+      }
+      size_t remaining = n;
+      char const* next = skipTokens(state.next, state.last, remaining);
+      consumed += static_cast<size_t>(next - state.next);
+      state.next = next;
+      return n - remaining;
+    }
+
+    template<typename T, typename S>
+    size_t skipTokens(DelimitedState<T, S> const& state, size_t n, size_t& consumed) {
+      if constexpr (isFieldRecord<T>) {
+        size_t i = 0;
+        for (; i < n; ++i) {
+          readValue(state, slot(state), consumed);
+          if (failed(state)) {
+            break;
+          }
+        }
+        return i;
+      }
+      std::string_view text;
+      bool escaped;
+      size_t i = 0;
+      while (i < n && nextItem(state, text, escaped, consumed)) {
+        ++i;
+      }
+      return i;
+    }
+
+    // Skip n values, starting with a value a comparison already
+    // read, recording the skip as one read
+    template<typename State>
+    size_t skipValues(State const& state, size_t n) {
+      size_t skipped = 0;
+      if (n && state.valid) {
+        if (failed(state)) {
+          return 0;
+        }
+        state.valid = false;
+        ++skipped;
+        --n;
+      }
+      if (n) {
+        size_t consumed = 0;
+        if constexpr (State::enabled) {
+          auto start = std::chrono::steady_clock::now();
+          skipped += skipTokens(state, n, consumed);
+          auto elapsed = std::chrono::steady_clock::now() - start;
+          state.recordRead(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed), consumed,
+                           failed(state) && !atEof(state));
+        }
+        else {
+          skipped += skipTokens(state, n, consumed);
+        }
+        countBytes(state, consumed);
+      }
+      for (size_t i = 0; i < skipped; ++i) {
+        state.recordElement();
+      }
+      return skipped;
+    }
+
+    /*------------------------------------------------------
+     * Sentinel search
+     *  - a memory source of searchable values finds its next
+     *    sentinel token once, by a memchr for its first byte
+     *    and a check of its length and boundaries, so which
+     *    value is the sentinel is known without reading or
+     *    comparing any value: the sentinel is next once the
+     *    source is past the token before it
+     *  - the search is kept until the pattern changes or the
+     *    source moves outside it (e.g. skips past the sentinel)
+     *  - an empty sentinel, or one holding whitespace, is not
+     *    searched for (it would match across tokens), so each
+     *    value is compared as before, and never matches
+     */
+
+    // Whether pattern can be a token: not empty, no whitespace
+    inline
+    bool isTokenPattern(std::string_view pattern) {
+      return !pattern.empty() && std::none_of(pattern.begin(), pattern.end(), [](char c) { return isSpace(c); });
+    }
+
+    // The first token equal to pattern in [from, last), or null
+    inline
+    char const* findToken(char const* first, char const* from, char const* last, std::string_view pattern) {
+      size_t n = pattern.size();
+      if (n == 0 || static_cast<size_t>(last - from) < n) {
+        return nullptr;
+      }
+      char const* end = last - n + 1;
+      for (char const* p = from; p != end; ++p) {
+        p = static_cast<char const*>(std::memchr(p, pattern[0], static_cast<size_t>(end - p)));
+        if (!p) {
+          return nullptr;
+        }
+        if ((p == first || isSpace(p[-1])) && (p + n == last || isSpace(p[n]))
+            && std::memcmp(p + 1, pattern.data() + 1, n - 1) == 0) {
+          return p;
+        }
+      }
+      return nullptr;
+    }
+
+    // Just past the token before the next sentinel, or null if
+    // no sentinel remains or it cannot be searched for
+    template<typename T, typename S>
+    char const* sentinelBoundary(MappedState<T, S> const& state, T const& sentinel) {
+      SentinelScan& scan = state.sentinelScan;
+      std::string_view pattern(sentinel.data(), sentinel.size());
+      if (!isTokenPattern(pattern)) {
+        return nullptr;
+      }
+      if (scan.from && scan.from <= state.next && (!scan.at || state.next <= scan.at) && scan.pattern == pattern) {
+        return scan.before;
+      }
+      scan.pattern.assign(pattern.data(), pattern.size());
+      scan.from = state.next;
+      scan.at = findToken(state.first, state.next, state.last, pattern);
+      scan.before = scan.at;
+      if (scan.at) {
+        while (scan.before != state.next && isSpace(scan.before[-1])) {
+          --scan.before;
+        }
+      }
+      return scan.before;
+    }
+
+    // Whether the next value is sentinel, reading it to find out
+    // unless a sentinel search can tell
+    template<typename State, typename T>
+    bool nextIs(State const& state, T const& sentinel) {
+      state.recordComparison(!state.valid);
+      return matches(hardCommit(state), sentinel);
+    }
+
+    template<typename T, typename S>
+    bool atSentinel(InputState<T, S> const& state, T const& sentinel) {
+      return nextIs(state, sentinel);
+    }
+
+    template<typename T, typename S>
+    bool atSentinel(MappedState<T, S> const& state, T const& sentinel) {
+      if constexpr (isSearchable<T>) {
+        if (!state.valid) {
+          if (char const* before = sentinelBoundary(state, sentinel)) {
+            state.recordComparison(false);
+            return state.next >= before;
+          }
+        }
+      }
+      return nextIs(state, sentinel);
+    }
+
+    template<typename T, typename S>
+    bool atSentinel(DelimitedState<T, S> const& state, T const& sentinel) {
+      return nextIs(state, sentinel);
+    }
+
+  }
+}
@@ -0,0 +1,99 @@
+// Copyright 2023, Gabriel Foust, All rights reserved
+#pragma once
+#include <array>
+#include <chrono>
+#include <cstddef>
+
+namespace cgf {
+
+  /*========================================================
+   * ScanStats
+   *  - counters collected by an iterator using CollectStats
+   *  - plain data, so it can be copied out, summed or
+   *    exported as is
+   */
+  struct ScanStats {
+    size_t reads = 0;         // reads from the source (a bulk binary read counts once)
+    size_t elements = 0;      // values stepped over by ++
+    size_t comparisons = 0;   // comparisons with a stopping condition
+    size_t forcedReads = 0;   // comparisons that had to read a value first
+    size_t failures = 0;      // reads that failed before end of input
+    size_t bytes = 0;         // bytes consumed (buffered and memory sources)
+
+    // Reads by duration: bucket i counts reads that took
+    // [2^i, 2^(i+1)) nanoseconds (bucket 0 also holds 0ns)
+    std::array<size_t, 32> readTime{};
+  };
+
+  /*========================================================
+   * Statistics policies for IstreamIterator
+   *  - NoStats records nothing and compiles away entirely;
+   *    it is an empty base, so it adds nothing to the
+   *    iterator's size
+   *  - CollectStats records into a caller-owned ScanStats,
+   *    which copies of the iterator share
+   */
+
+  struct NoStats {
+    static constexpr bool enabled = false;
+
+    void recordRead(std::chrono::nanoseconds, size_t, bool) const {
+    }
+
+    void recordElement() const {
+    }
+
+    void recordComparison(bool) const {
+    }
+  };
+
+  class CollectStats {
+  public:
+    static constexpr bool enabled = true;
+
+    CollectStats() = default;
+
+    CollectStats(ScanStats& sink) : _sink{ &sink } {
+    }
+
+    ScanStats* sink() const {
+      return _sink;
+    }
+
+    void recordRead(std::chrono::nanoseconds elapsed, size_t bytes, bool failed) const {
+      if (_sink) {
+        ++_sink->reads;
+        _sink->bytes += bytes;
+        _sink->failures += failed;
+        ++_sink->readTime[bucket(static_cast<unsigned long long>(elapsed.count()))];
+      }
+    }
+
+    void recordElement() const {
+      if (_sink) {
+        ++_sink->elements;
+      }
+    }
+
+    void recordComparison(bool forcedRead) const {
+      if (_sink) {
+        ++_sink->comparisons;
+        _sink->forcedReads += forcedRead;
+      }
+    }
+
+  private:
+    ScanStats* _sink = nullptr;
+
+    static
+    size_t bucket(unsigned long long ns) {
+      size_t i = 0;
+      while (ns > 1 && i + 1 < ScanStats{}.readTime.size()) {
+        ns >>= 1;
+        ++i;
+      }
+      return i;
+    }
+  };
+
+}
@@ -0,0 +1,202 @@
+// Copyright 2023, Gabriel Foust, All rights reserved
+#pragma once
+#include <cstddef>
+#include <istream>
+#include <iterator>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include "parse.hpp"
+#include "state.hpp"
+
+namespace cgf {
+
+  /*========================================================
+   * Stopping conditions as policy types (see StopIterator)
+   */
+  namespace stop {
+
+    // Every value up to end of input
+    struct Eof {
+    };
+
+    // The first value values read (value counts down)
+    struct Count {
+      size_t value;
+    };
+
+    // Values before the first one equal to value
+    template<typename T>
+    struct Sentinel {
+      T value;
+    };
+
+    template<typename T>
+    Sentinel(T) -> Sentinel<T>;
+
+  }
+
+  namespace detail {
+
+    template<typename S>
+    struct IsStopPolicy : std::false_type {};
+
+    template<>
+    struct IsStopPolicy<stop::Eof> : std::true_type {};
+
+    template<>
+    struct IsStopPolicy<stop::Count> : std::true_type {};
+
+    template<typename T>
+    struct IsStopPolicy<stop::Sentinel<T>> : std::true_type {};
+
+    template<typename S>
+    inline constexpr bool isStopPolicy = IsStopPolicy<S>::value;
+
+  }
+
+  /*========================================================
+   * StopIterator
+   *  - an input iterator whose stopping condition is part of
+   *    its type, so no stopping condition is dispatched at
+   *    run time:
+   *      stop::Eof        ends when a read finds no value
+   *      stop::Count      a counter, decremented by ++
+   *      stop::Sentinel   a direct compare with each value
+   *  - values are read eagerly, on construction and by ++, and
+   *    the end test is settled by the read itself; a Count
+   *    iterator never reads past its last value
+   *  - a failed read throws std::istream::failure from the
+   *    constructor or ++ (as does end of input before a Count
+   *    or Sentinel is satisfied)
+   *  - the end iterator is default constructed (in C++20,
+   *    std::default_sentinel also works)
+   *  - State is detail::InputState or detail::MappedState (or
+   *    detail::DelimitedState); see the scan overloads below
+   */
+  template<typename T, typename Stop = stop::Eof, typename State = detail::InputState<std::remove_cv_t<T>>>
+  class StopIterator {
+    static_assert(detail::isStopPolicy<Stop>, "Stop must be stop::Eof, stop::Count or stop::Sentinel");
+
+  public:
+    /*------------------------------------------------------
+     * Iterator traits
+     */
+    using difference_type = ptrdiff_t;
+    using value_type = std::remove_cv_t<T>;
+    using pointer = value_type*;
+    using reference = value_type&;
+    using iterator_category = std::input_iterator_tag;
+
+    /*------------------------------------------------------
+     * Constructors
+     */
+
+    StopIterator() = default;
+
+    StopIterator(State state, Stop stop) : _state{ std::move(state) }, _stop{ std::move(stop) }, _done{ false } {
+      if constexpr (std::is_same_v<Stop, stop::Count>) {
+        if (_stop.value == 0) {
+          _done = true;
+          return;
+        }
+      }
+      next();
+    }
+
+    /*------------------------------------------------------
+     * Iterator operators
+     */
+
+    reference operator *() const {
+      return detail::slot(_state);
+    }
+
+    pointer operator ->() const {
+      return &detail::slot(_state);
+    }
+
+    StopIterator& operator ++() {
+      _state.recordElement();
+      if constexpr (std::is_same_v<Stop, stop::Count>) {
+        if (--_stop.value == 0) {
+          _done = true;
+          return *this;
+        }
+      }
+      next();
+      return *this;
+    }
+
+    StopIterator operator ++(int) {
+      StopIterator copy = *this;
+      ++*this;
+      return copy;
+    }
+
+    // Iterators compare equal when both have stopped
+    bool operator ==(StopIterator const& rhs) const {
+      return _done == rhs._done;
+    }
+
+    bool operator !=(StopIterator const& rhs) const {
+      return _done != rhs._done;
+    }
+
+#if defined(CGF_CPP20)
+    friend
+    bool operator ==(StopIterator const& it, std::default_sentinel_t) {
+      return it._done;
+    }
+#endif
+
+    bool done() const {
+      return _done;
+    }
+
+  private:
+    // Read the next value and settle whether iteration ends
+    void next() {
+      detail::fetch(_state, detail::slot(_state));
+      if (detail::failed(_state)) {
+        if constexpr (std::is_same_v<Stop, stop::Eof>) {
+          if (detail::atEof(_state)) {
+            _done = true;
+            return;
+          }
+        }
+        throw std::istream::failure("input failure");
+      }
+      if constexpr (!std::is_same_v<Stop, stop::Eof> && !std::is_same_v<Stop, stop::Count>) {
+        _done = detail::slot(_state) == _stop.value;
+      }
+    }
+
+    State _state{};
+    Stop _stop{};
+    bool _done = true;
+  };
+
+  /*========================================================
+   * Convenience factory functions
+   *  - scan<int>(in, stop::Count{ n }), scan<int>(text, stop::Eof{}), ...
+   */
+
+  template<typename T, typename Stop, std::enable_if_t<detail::isStopPolicy<Stop>, int> = 0> inline
+  StopIterator<T, Stop> scan(std::istream& in, Stop stop, ParseMode mode = ParseMode::Stream) {
+    return StopIterator<T, Stop>(detail::InputState<T>{ {}, &in, false, {}, mode, nullptr, nullptr }, std::move(stop));
+  }
+
+  template<typename T, typename Stop, std::enable_if_t<detail::isStopPolicy<Stop>, int> = 0> inline
+  StopIterator<T, Stop, detail::MappedState<T>> scan(std::string_view text, Stop stop) {
+    char const* first = text.data();
+    return StopIterator<T, Stop, detail::MappedState<T>>(
+      detail::MappedState<T>{ {}, first, first, first + text.size(), false, false, false, {}, nullptr, nullptr }, std::move(stop));
+  }
+
+#if defined(CGF_CPP20)
+  static_assert(std::input_iterator<StopIterator<double>>);
+  static_assert(std::sentinel_for<std::default_sentinel_t, StopIterator<double, stop::Count>>);
+#endif
+
+}
@@ -0,0 +1,1115 @@
+// Copyright 2023, Gabriel Foust, All rights reserved
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
+#include "async.hpp"
+#include "compressed.hpp"
+#include "index.hpp"
+#include "input.hpp"
+#include "output.hpp"
+#include "prefetch.hpp"
+#include "ranges.hpp"
+#include "reduce.hpp"
+#include "simd.hpp"
+
+/*========================================================
+ * Correctness tests
+ *  - every parse mode and source is checked against what
+ *    operator >> reads from the same text, and every SIMD
+ *    kernel against the scalar one
+ *  - corpora are generated as in bench.cpp, only smaller,
+ *    with negative numbers, long tokens and every whitespace
+ *    character added
+ *  - built as C++17 (tests) and as C++20 (tests20), which
+ *    adds the ranges and asynchronous sources
+ *  - prints each failed check and exits with 1 if any
+ *    failed; arguments pick tests by name prefix, e.g.
+ *      tests sources/ kernel
+ */
+
+// A binary record whose fields are swapped one by one
+struct Sample {
+  int32_t id;
+  double value;
+  uint16_t flags;
+};
+
+template<>
+struct cgf::Fields<Sample> {
+  static constexpr auto members = std::make_tuple(&Sample::id, &Sample::value, &Sample::flags);
+};
+
+bool operator ==(Sample const& a, Sample const& b) {
+  return a.id == b.id && a.value == b.value && a.flags == b.flags;
+}
+
+std::ostream& operator <<(std::ostream& out, Sample const& s) {
+  return out << '{' << s.id << ' ' << s.value << ' ' << s.flags << '}';
+}
+
+namespace {
+
+  using cgf::ParseMode;
+
+  /*------------------------------------------------------
+   * Checks
+   *  - a failed check prints the test, the trace of where it
+   *    was made (see Trace), and what differed; the test
+   *    goes on unless the caller returns on false
+   */
+  struct Run {
+    char const* test = "";
+    std::vector<std::string> trace;
+    size_t checks = 0;
+    size_t failures = 0;
+  };
+
+  Run run;
+
+  template<typename V>
+  std::string show(V const& value) {
+    std::ostringstream out;
+    out << value;
+    return out.str();
+  }
+
+  // Names where the checks inside its scope are made
+  struct Trace {
+    template<typename V>
+    explicit
+    Trace(V const& where) {
+      run.trace.push_back(show(where));
+    }
+
+    Trace(Trace const&) = delete;
+    Trace& operator =(Trace const&) = delete;
+
+    ~Trace() {
+      run.trace.pop_back();
+    }
+  };
+
+  bool check(bool ok, std::string const& what) {
+    ++run.checks;
+    if (!ok) {
+      ++run.failures;
+      std::cerr << run.test;
+      for (std::string const& where : run.trace) {
+        std::cerr << " / " << where;
+      }
+      std::cerr << ": " << what << '\n';
+    }
+    return ok;
+  }
+
+  template<typename A, typename B>
+  bool checkEqual(A const& actual, B const& expected, char const* what) {
+    if (actual == expected) {
+      return check(true, {});
+    }
+    return check(false, std::string(what) + " is " + show(actual) + ", expected " + show(expected));
+  }
+
+  template<typename T>
+  bool checkSame(std::vector<T> const& actual, std::vector<T> const& expected) {
+    size_t n = std::min(actual.size(), expected.size());
+    size_t i = static_cast<size_t>(std::mismatch(actual.begin(), actual.begin() + n, expected.begin()).first - actual.begin());
+    if (i == n && actual.size() == expected.size()) {
+      return check(true, {});
+    }
+    std::string what = "read " + show(actual.size()) + " values, expected " + show(expected.size());
+    if (i < n) {
+      what += "; value " + show(i) + " is " + show(actual[i]) + ", expected " + show(expected[i]);
+    }
+    return check(false, what);
+  }
+
+  /*------------------------------------------------------
+   * Corpora
+   *  - each token is followed by one to three whitespace
+   *    characters, so the text ends with whitespace
+   */
+  enum class Tokens {
+    SmallInt,   // -99 to 99
+    LargeInt,   // any long long
+    Real,       // doubles over many magnitudes, either sign,
+                // with the odd underflow and other edge case
+    Word,       // 1 to 12 lowercase letters
+    LongWord,   // 1 to 300 characters, crossing buffer ends
+  };
+
+  constexpr size_t corpusTokens = 20000;
+
+  std::string corpus(Tokens kind) {
+    std::mt19937_64 rng(42);
+    std::string text;
+    char buffer[32];
+    for (size_t i = 0; i < corpusTokens; ++i) {
+      switch (kind) {
+      case Tokens::SmallInt:
+        text += std::to_string(static_cast<int>(rng() % 199) - 99);
+        break;
+      case Tokens::LargeInt:
+        text += std::to_string(static_cast<long long>(rng()));
+        break;
+      case Tokens::Real: {
+        if (rng() % 50 == 0) {
+          // tokens operator >> reads, but from_chars alone does
+          // not read the same way
+          char const* const edges[] = { "1e-400", "-1e-400", "2e-324", "4e-324", "-0.0000001e-320", "+2.5", "-0",
+                                        ".5", "5.", "1E5", "0e999999999999" };
+          text += edges[rng() % std::size(edges)];
+          break;
+        }
+        double value = std::uniform_real_distribution<double>(-1, 1)(rng) * std::pow(10.0, static_cast<int>(rng() % 40) - 20);
+        text.append(buffer, std::to_chars(buffer, buffer + sizeof buffer, value).ptr);
+        break;
+      }
+      case Tokens::Word:
+        for (size_t k = 1 + rng() % 12; k; --k) {
+          text += static_cast<char>('a' + rng() % 26);
+        }
+        break;
+      case Tokens::LongWord:
+        for (size_t k = 1 + rng() % 300; k; --k) {
+          text += "abcdefghijklmnopqrstuvwxyz0123456789,;!"[rng() % 39];
+        }
+        break;
+      }
+      text.append(1 + rng() % 3, " \t\n\v\f\r"[rng() % 6]);
+    }
+    return text;
+  }
+
+  // What operator >> reads
+  template<typename T>
+  std::vector<T> extracted(std::string const& text) {
+    std::istringstream in(text);
+    return std::vector<T>(std::istream_iterator<T>(in), std::istream_iterator<T>());
+  }
+
+  /*------------------------------------------------------
+   * Sources
+   *  - the same text through each way of reading it; the
+   *    prefetch and gzip sources use small blocks, so tokens
+   *    are cut by block ends
+   */
+  enum class Source {
+    Stream,
+    Buffered,
+    Memory,
+    Prefetch,
+    PrefetchStream,
+    Gzip,
+  };
+
+  char const* name(Source source) {
+    switch (source) {
+    case Source::Stream: return "stream";
+    case Source::Buffered: return "buffered";
+    case Source::Memory: return "memory";
+    case Source::Prefetch: return "prefetch/buffered";
+    case Source::PrefetchStream: return "prefetch/stream";
+    case Source::Gzip: return "gzip/buffered";
+    }
+    return "";
+  }
+
+  constexpr Source sources[] = {
+    Source::Stream, Source::Buffered, Source::Memory, Source::Prefetch, Source::PrefetchStream,
+#if defined(CGF_HAS_ZLIB)
+    Source::Gzip,
+#endif
+  };
+
+  constexpr size_t smallBlock = 1021;
+
+  // Streambuf over existing memory, as in bench.cpp
+  struct MemoryBuf : std::streambuf {
+    explicit
+    MemoryBuf(std::string const& text) {
+      char* first = const_cast<char*>(text.data());
+      setg(first, first, first + text.size());
+    }
+  };
+
+#if defined(CGF_HAS_ZLIB)
+  std::string gzip(std::string_view text) {
+    std::string data(compressBound(static_cast<uLong>(text.size())) + 32, '\0');
+    z_stream stream{};
+    deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY);
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(text.data()));
+    stream.avail_in = static_cast<uInt>(text.size());
+    stream.next_out = reinterpret_cast<Bytef*>(data.data());
+    stream.avail_out = static_cast<uInt>(data.size());
+    deflate(&stream, Z_FINISH);
+    data.resize(stream.total_out);
+    deflateEnd(&stream);
+    return data;
+  }
+#endif
+
+  // Calls f with an iterator at the start of text read from source
+  template<typename T, typename F>
+  void withSource(std::string const& text, Source source, F&& f) {
+    Trace trace(name(source));
+    switch (source) {
+    case Source::Stream:
+    case Source::Buffered: {
+      MemoryBuf buf(text);
+      std::istream in(&buf);
+      f(cgf::scan<T>(in, source == Source::Stream ? ParseMode::Stream : ParseMode::Buffered));
+      break;
+    }
+    case Source::Memory:
+      f(cgf::scan<T>(std::string_view(text)));
+      break;
+    case Source::Prefetch:
+    case Source::PrefetchStream: {
+      MemoryBuf buf(text);
+      cgf::PrefetchBuf prefetch(buf, smallBlock);
+      std::istream in(&prefetch);
+      f(cgf::scan<T>(in, source == Source::PrefetchStream ? ParseMode::Stream : ParseMode::Buffered));
+      break;
+    }
+    case Source::Gzip: {
+#if defined(CGF_HAS_ZLIB)
+      std::string data = gzip(text);
+      cgf::DecompressBuf decompress(std::string_view(data), cgf::Compression::Auto, smallBlock);
+      std::istream in(&decompress);
+      f(cgf::scan<T>(in, ParseMode::Buffered));
+#endif
+      break;
+    }
+    }
+  }
+
+  template<typename T>
+  std::vector<T> readAll(cgf::IstreamIterator<T> p, cgf::IstreamIterator<T> const& end) {
+    std::vector<T> values;
+    for (; p != end; ++p) {
+      values.push_back(*p);
+    }
+    return values;
+  }
+
+  // Reads in blocks of an odd size until the batch read stops
+  // for a reason other than a full block, which should be last
+  template<typename T>
+  std::vector<T> readBatches(cgf::IstreamIterator<T>& p, cgf::IstreamIterator<T> const& end, cgf::StopReason last) {
+    std::vector<T> values;
+    std::vector<T> block(37);
+    cgf::ReadResult result;
+    do {
+      result = p.readInto(block.data(), block.size(), end);
+      values.insert(values.end(), block.begin(), block.begin() + static_cast<ptrdiff_t>(result.count));
+    } while (result.reason == cgf::StopReason::Full);
+    checkEqual(static_cast<int>(result.reason), static_cast<int>(last), "stop reason");
+    return values;
+  }
+
+  /*------------------------------------------------------
+   * Every source and stopping condition, against operator >>
+   */
+  template<typename T>
+  void checkSources(Tokens kind) {
+    std::string const text = corpus(kind);
+    std::vector<T> const expected = extracted<T>(text);
+    if (!checkEqual(expected.size(), corpusTokens, "corpus size")) {
+      return;
+    }
+
+    size_t const count = corpusTokens / 3;
+    std::vector<T> const prefix(expected.begin(), expected.begin() + count);
+    // the first occurrence of a later value stops a sentinel search
+    T const sentinel = expected[corpusTokens / 2];
+    std::vector<T> const beforeSentinel(expected.begin(), std::find(expected.begin(), expected.end(), sentinel));
+
+    for (Source source : sources) {
+      withSource<T>(text, source, [&](cgf::IstreamIterator<T> p) {
+        Trace trace("eof");
+        checkSame(readAll(p, cgf::untilEof<T>()), expected);
+      });
+      withSource<T>(text, source, [&](cgf::IstreamIterator<T> p) {
+        Trace trace("eof/batch");
+        checkSame(readBatches(p, cgf::untilEof<T>(), cgf::StopReason::Eof), expected);
+      });
+      withSource<T>(text, source, [&](cgf::IstreamIterator<T> p) {
+        Trace trace("count");
+        checkSame(readAll(p, cgf::untilCount<T>(count)), prefix);
+      });
+      withSource<T>(text, source, [&](cgf::IstreamIterator<T> p) {
+        Trace trace("count/batch");
+        checkSame(readBatches(p, cgf::untilCount<T>(count), cgf::StopReason::Count), prefix);
+        checkEqual(p.count(), count, "count()");
+      });
+      withSource<T>(text, source, [&](cgf::IstreamIterator<T> p) {
+        Trace trace("sentinel");
+        checkSame(readAll(p, cgf::untilSentinel<T>(sentinel)), beforeSentinel);
+      });
+      withSource<T>(text, source, [&](cgf::IstreamIterator<T> p) {
+        Trace trace("sentinel/batch");
+        checkSame(readBatches(p, cgf::untilSentinel<T>(sentinel), cgf::StopReason::Sentinel), beforeSentinel);
+        // the sentinel is left as the next value
+        checkEqual(*p, sentinel, "next value");
+      });
+    }
+  }
+
+  void sourcesSmallInt() {
+    checkSources<int>(Tokens::SmallInt);
+  }
+
+  void sourcesLargeInt() {
+    checkSources<long long>(Tokens::LargeInt);
+  }
+
+  void sourcesReal() {
+    checkSources<double>(Tokens::Real);
+    checkSources<float>(Tokens::Real);
+  }
+
+  // Negative tokens wrap, as operator >> reads them
+  void sourcesUnsigned() {
+    checkSources<unsigned>(Tokens::SmallInt);
+    checkSources<unsigned long long>(Tokens::LargeInt);
+  }
+
+  // Tokens from_chars takes but operator >> rejects are errors
+  // in every mode
+  void sourcesRejected() {
+    for (char const* token : { "nan", "NaN", "-nan", "inf", "-inf", "+inf", "infinity", "1e400" }) {
+      Trace trace(token);
+      std::string const text = std::string("1 ") + token + " 2 ";
+      std::vector<double> const expected{ 1, 2 };
+      {
+        cgf::ErrorSink errors;
+        checkSame(readAll(cgf::scan<double>(std::string_view(text), errors), cgf::untilEof<double>()), expected);
+        checkEqual(errors.count(), size_t(1), "memory errors");
+      }
+      for (ParseMode mode : { ParseMode::Stream, ParseMode::Buffered }) {
+        Trace where(mode == ParseMode::Stream ? "stream" : "buffered");
+        std::istringstream in(text);
+        cgf::ErrorSink errors;
+        checkSame(readAll(cgf::scan<double>(in, errors, mode), cgf::untilEof<double>()), expected);
+        checkEqual(errors.count(), size_t(1), "errors");
+      }
+    }
+  }
+
+  void sourcesWord() {
+    checkSources<std::string>(Tokens::Word);
+  }
+
+  void sourcesLongWord() {
+    checkSources<std::string>(Tokens::LongWord);
+  }
+
+  void sourcesStringView() {
+    for (Tokens kind : { Tokens::Word, Tokens::LongWord }) {
+      std::string const text = corpus(kind);
+      auto views = readAll(cgf::scan<std::string_view>(std::string_view(text)), cgf::untilEof<std::string_view>());
+      checkSame(std::vector<std::string>(views.begin(), views.end()), extracted<std::string>(text));
+    }
+  }
+
+#if defined(CGF_CPP20)
+  /*------------------------------------------------------
+   * Ranges
+   *  - ScanIterator and views::scan, over a stream in each
+   *    text mode and over memory, against operator >>
+   */
+  template<typename T, typename It, typename End>
+  std::vector<T> readRange(It p, End end) {
+    std::vector<T> values;
+    for (; p != end; ++p) {
+      values.push_back(*p);
+    }
+    return values;
+  }
+
+  template<typename T, typename R>
+  std::vector<T> collect(R&& range) {
+    std::vector<T> values;
+    for (auto const& value : range) {
+      values.push_back(value);
+    }
+    return values;
+  }
+
+  template<typename T>
+  void checkRanges(Tokens kind) {
+    std::string const text = corpus(kind);
+    std::vector<T> const expected = extracted<T>(text);
+    size_t const count = corpusTokens / 3;
+    std::vector<T> const prefix(expected.begin(), expected.begin() + static_cast<ptrdiff_t>(count));
+    for (ParseMode mode : { ParseMode::Stream, ParseMode::Buffered }) {
+      Trace trace(mode == ParseMode::Stream ? "stream" : "buffered");
+      {
+        MemoryBuf buf(text);
+        std::istream in(&buf);
+        checkSame(readRange<T>(cgf::ranges::scan<T>(in, mode), cgf::ranges::untilEof()), expected);
+      }
+      {
+        MemoryBuf buf(text);
+        std::istream in(&buf);
+        checkSame(collect<T>(in | cgf::views::scan<T>(mode) | std::views::take(count)), prefix);
+      }
+    }
+    Trace trace("memory");
+    std::string_view const view(text);
+    checkSame(readRange<T>(cgf::ranges::scan<T>(view), cgf::ranges::untilEof()), expected);
+    checkSame(readRange<T>(cgf::ranges::scan<T>(view), cgf::ranges::untilCount(count)), prefix);
+    std::vector<T> const untilValue(expected.begin(), std::find(expected.begin(), expected.end(), expected[count]));
+    checkSame(readRange<T>(cgf::ranges::scan<T>(view), cgf::ranges::untilSentinel(expected[count])), untilValue);
+    checkSame(collect<T>(view | cgf::views::scan<T> | std::views::take(count)), prefix);
+  }
+
+  void rangesInt() {
+    checkRanges<int>(Tokens::SmallInt);
+  }
+
+  void rangesReal() {
+    checkRanges<double>(Tokens::Real);
+  }
+
+  void rangesLongWord() {
+    checkRanges<std::string>(Tokens::LongWord);
+  }
+#endif
+
+#if defined(CGF_CPP20) && defined(__cpp_impl_coroutine)
+  /*------------------------------------------------------
+   * Asynchronous scanning
+   *  - a Feed pushed in packets of several sizes, so tokens
+   *    are cut between packets, against operator >>
+   */
+  struct Detached {
+    struct promise_type {
+      Detached get_return_object() {
+        return {};
+      }
+
+      std::suspend_never initial_suspend() {
+        return {};
+      }
+
+      std::suspend_never final_suspend() noexcept {
+        return {};
+      }
+
+      void return_void() {
+      }
+
+      void unhandled_exception() {
+        check(false, "asynchronous scan threw");
+      }
+    };
+  };
+
+  template<typename T>
+  Detached consume(cgf::AsyncGenerator<T> values, std::vector<T>& out, bool& done) {
+    while (T* value = co_await values.next()) {
+      out.push_back(*value);
+    }
+    done = true;
+  }
+
+  template<typename T>
+  std::vector<T> readFeed(std::string const& text, size_t packet, cgf::IstreamIterator<T> end) {
+    cgf::Feed feed;
+    std::vector<T> values;
+    bool done = false;
+    consume(cgf::scanAsync<T>(feed, std::move(end)), values, done);
+    for (size_t i = 0; i < text.size(); i += packet) {
+      feed.push(std::string_view(text).substr(i, packet));
+    }
+    feed.close();
+    check(done, "asynchronous scan did not finish");
+    return values;
+  }
+
+  template<typename T>
+  void checkAsync(Tokens kind) {
+    std::string const text = corpus(kind);
+    std::vector<T> const expected = extracted<T>(text);
+    size_t const count = corpusTokens / 3;
+    std::vector<T> const prefix(expected.begin(), expected.begin() + static_cast<ptrdiff_t>(count));
+    for (size_t packet : { size_t(7), size_t(1460), text.size() }) {
+      Trace trace("packets of " + show(packet));
+      checkSame(readFeed<T>(text, packet, cgf::untilEof<T>()), expected);
+      checkSame(readFeed<T>(text, packet, cgf::untilCount<T>(count)), prefix);
+    }
+  }
+
+  void asyncInt() {
+    checkAsync<int>(Tokens::SmallInt);
+  }
+
+  void asyncReal() {
+    checkAsync<double>(Tokens::Real);
+  }
+
+  void asyncLongWord() {
+    checkAsync<std::string>(Tokens::LongWord);
+  }
+#endif
+
+  /*------------------------------------------------------
+   * Sentinel search
+   *  - a string sentinel in memory is found by a byte search,
+   *    which must agree with comparing each value
+   */
+  void sentinelWholeTokens() {
+    std::string const text = "ab abc xabc abcx abc\tend ";
+    std::vector<std::string> const all = extracted<std::string>(text);
+    for (std::string sentinel : { "abc", "end", "ab", "xabc", "abcx" }) {
+      Trace trace(sentinel);
+      std::vector<std::string> const expected(all.begin(), std::find(all.begin(), all.end(), sentinel));
+      checkSame(readAll(cgf::scan<std::string>(std::string_view(text)), cgf::untilSentinel<std::string>(sentinel)),
+                expected);
+      auto p = cgf::scan<std::string>(std::string_view(text));
+      checkSame(readBatches(p, cgf::untilSentinel<std::string>(sentinel), cgf::StopReason::Sentinel), expected);
+    }
+  }
+
+  void sentinelNotAcrossTokens() {
+    // no token is empty or holds whitespace, so these never match
+    std::string const text = "x a b c ";
+    for (std::string sentinel : { "a b", "", "b\tc" }) {
+      Trace trace(sentinel);
+      auto p = cgf::scan<std::string>(std::string_view(text));
+      checkSame(readBatches(p, cgf::untilSentinel<std::string>(sentinel), cgf::StopReason::Eof),
+                extracted<std::string>(text));
+    }
+  }
+
+  /*------------------------------------------------------
+   * Skip, seek and random access
+   */
+  template<typename T>
+  void checkSkip(Tokens kind) {
+    std::string const text = corpus(kind);
+    std::vector<T> const expected = extracted<T>(text);
+    for (Source source : sources) {
+      for (size_t n : { size_t(0), size_t(1), size_t(7), size_t(1000), corpusTokens - 1, corpusTokens, corpusTokens + 5 }) {
+        withSource<T>(text, source, [&](cgf::IstreamIterator<T> p) {
+          Trace trace(n);
+          // read one value first, so skip starts from a lookahead
+          size_t first = n ? 1 : 0;
+          if (first) {
+            checkEqual(*p, expected[0], "first value");
+            ++p;
+          }
+          checkEqual(p.skip(n - first), std::min(n, corpusTokens) - first, "skip()");
+          checkEqual(p.count(), std::min(n, corpusTokens), "count()");
+          if (n < corpusTokens) {
+            checkEqual(*p, expected[n], "next value");
+          }
+          else {
+            check(p == cgf::untilEof<T>(), "not at end");
+          }
+        });
+      }
+    }
+  }
+
+  void skipInt() {
+    checkSkip<int>(Tokens::SmallInt);
+  }
+
+  void skipReal() {
+    checkSkip<double>(Tokens::Real);
+  }
+
+  void skipLongWord() {
+    checkSkip<std::string>(Tokens::LongWord);
+  }
+
+  void seekOffset() {
+    std::string const text = corpus(Tokens::Real);
+    std::vector<double> const expected = extracted<double>(text);
+    for (size_t n : { size_t(0), size_t(3), size_t(12345) }) {
+      Trace trace(n);
+      auto p = cgf::scan<double>(std::string_view(text));
+      p.skip(n);
+      size_t offset = p.offset();
+      auto q = cgf::scan<double>(std::string_view(text));
+      q.seek(offset, n);
+      checkEqual(q.count(), n, "count()");
+      checkEqual(*q, expected[n], "value at offset");
+
+      for (ParseMode mode : { ParseMode::Stream, ParseMode::Buffered }) {
+        std::istringstream in(text);
+        auto s = cgf::scan<double>(in, mode);
+        s.seek(offset, n);
+        checkEqual(*s, expected[n], "value at stream offset");
+      }
+    }
+  }
+
+  void tokenIndex() {
+    std::string const text = corpus(Tokens::LongWord);
+    std::vector<std::string> const expected = extracted<std::string>(text);
+    cgf::TokenIndex const index = cgf::TokenIndex::build(text, 16);
+    checkEqual(index.tokens(), corpusTokens, "tokens()");
+    checkEqual(index.bytes(), text.size(), "bytes()");
+    for (uint64_t ordinal = 0; ordinal < corpusTokens; ordinal += 97) {
+      Trace trace(ordinal);
+      auto p = cgf::scanAt<std::string>(text, index, ordinal);
+      checkEqual(p.count(), ordinal, "count()");
+      checkEqual(*p, expected[ordinal], "value");
+      std::istringstream in(text);
+      checkEqual(*cgf::scanAt<std::string>(in, index, ordinal, ParseMode::Buffered), expected[ordinal], "stream value");
+    }
+    check(cgf::scanAt<std::string>(text, index, corpusTokens) == cgf::untilEof<std::string>(), "not at end");
+
+    // a saved index loads back the same
+    std::stringstream file;
+    index.save(file);
+    cgf::TokenIndex const loaded = cgf::TokenIndex::load(file);
+    checkEqual(*cgf::scanAt<std::string>(text, loaded, 4321), expected[4321], "value from loaded index");
+  }
+
+  /*------------------------------------------------------
+   * SIMD kernels, against the scalar kernel
+   *  - at every start offset of random buffers, so every
+   *    alignment and tail length is covered
+   */
+  namespace simd = cgf::detail::simd;
+
+  struct NamedKernel {
+    char const* name;
+    simd::Kernel kernel;
+  };
+
+  std::vector<NamedKernel> kernels() {
+    std::vector<NamedKernel> all{ { "selected", simd::kernel() } };
+#if defined(CGF_SIMD_X86)
+    all.push_back({ "sse2", { simd::sse2::findSpace, simd::sse2::skipSpace, simd::sse2::findAny, simd::sse2::skipTokens } });
+    if (simd::avx2::supported()) {
+      all.push_back({ "avx2", { simd::avx2::findSpace, simd::avx2::skipSpace, simd::avx2::findAny, simd::avx2::skipTokens } });
+    }
+#elif defined(CGF_SIMD_NEON)
+    all.push_back({ "neon", { simd::neon::findSpace, simd::neon::skipSpace, simd::neon::findAny, simd::neon::skipTokens } });
+#endif
+    return all;
+  }
+
+  // Whether kernel agrees with the scalar kernel on [p, p + n)
+  bool sameAsScalar(simd::Kernel const& kernel, char const* p, size_t n) {
+    bool ok = checkEqual(kernel.findSpace(p, n), simd::scalar::findSpace(p, n), "findSpace")
+              && checkEqual(kernel.skipSpace(p, n), simd::scalar::skipSpace(p, n), "skipSpace")
+              && checkEqual(kernel.findAny(p, n, ',', '"', '\n'), simd::scalar::findAny(p, n, ',', '"', '\n'), "findAny");
+    for (size_t tokens : { 1, 2, 3, 5, 17 }) {
+      for (bool inToken : { false, true }) {
+        size_t expectedTokens = tokens;
+        bool expectedIn = inToken;
+        size_t expected = simd::scalar::skipTokens(p, n, expectedTokens, expectedIn);
+        size_t actualTokens = tokens;
+        bool actualIn = inToken;
+        ok = ok && checkEqual(kernel.skipTokens(p, n, actualTokens, actualIn), expected, "skipTokens")
+             && checkEqual(actualTokens, expectedTokens, "skipTokens tokens")
+             && checkEqual(actualIn, expectedIn, "skipTokens inToken");
+      }
+    }
+    return ok;
+  }
+
+  void kernelsMatchScalar() {
+    // whitespace, then the bytes either side of '\t' to '\r',
+    // bytes with the high bit set, delimiters and a NUL
+    std::string const alphabet = std::string(" \t\n\v\f\r\x08\x0e\x1f\x7f\x80\xff,\"a9") + '\0';
+    size_t const spaces = 6;
+    std::mt19937_64 rng(42);
+    for (NamedKernel const& named : kernels()) {
+      Trace trace(named.name);
+      for (size_t length : { 0, 1, 15, 16, 17, 31, 32, 33, 63, 64, 65, 200 }) {
+        for (size_t trial = 0; trial < 20; ++trial) {
+          // vary how often whitespace occurs, so runs of either
+          // kind are long and short
+          size_t density = 1 + trial % 12;
+          std::string buffer(length, ' ');
+          for (char& c : buffer) {
+            c = alphabet[rng() % 16 < density ? rng() % spaces : spaces + rng() % (alphabet.size() - spaces)];
+          }
+          for (size_t start = 0; start <= length; ++start) {
+            Trace where("length " + show(length) + " from " + show(start));
+            if (!sameAsScalar(named.kernel, buffer.data() + start, length - start)) {
+              return;
+            }
+          }
+        }
+      }
+    }
+  }
+
+  /*------------------------------------------------------
+   * Binary records
+   *  - records written in either byte order read back the
+   *    same, one at a time and in bulk
+   */
+  template<typename F>
+  void putField(char* slot, F value, bool bigEndian) {
+    unsigned char bytes[sizeof(F)];
+    std::memcpy(bytes, &value, sizeof(F));
+    if (bigEndian != cgf::detail::bigEndianHost) {
+      std::reverse(bytes, bytes + sizeof(F));
+    }
+    std::memcpy(slot, bytes, sizeof(F));
+  }
+
+  std::string sampleFile(std::vector<Sample> const& samples, bool bigEndian) {
+    std::string bytes(samples.size() * sizeof(Sample), '\0');
+    for (size_t i = 0; i < samples.size(); ++i) {
+      char* slot = bytes.data() + i * sizeof(Sample);
+      putField(slot + offsetof(Sample, id), samples[i].id, bigEndian);
+      putField(slot + offsetof(Sample, value), samples[i].value, bigEndian);
+      putField(slot + offsetof(Sample, flags), samples[i].flags, bigEndian);
+    }
+    return bytes;
+  }
+
+  void binaryRecords() {
+    std::mt19937_64 rng(42);
+    std::vector<Sample> samples(1000);
+    for (Sample& s : samples) {
+      s = { static_cast<int32_t>(rng()), static_cast<double>(static_cast<int64_t>(rng())) / 1024,
+            static_cast<uint16_t>(rng()) };
+    }
+    for (ParseMode mode : { ParseMode::Binary, ParseMode::BinaryBigEndian }) {
+      Trace trace(mode == ParseMode::Binary ? "little-endian" : "big-endian");
+      std::string const bytes = sampleFile(samples, mode == ParseMode::BinaryBigEndian);
+      {
+        std::istringstream in(bytes);
+        checkSame(readAll(cgf::scan<Sample>(in, mode), cgf::untilEof<Sample>()), samples);
+      }
+      {
+        std::istringstream in(bytes);
+        cgf::IstreamIterator<Sample> p = cgf::scan<Sample>(in, mode);
+        checkSame(readBatches(p, cgf::untilEof<Sample>(), cgf::StopReason::Eof), samples);
+      }
+    }
+  }
+
+  /*------------------------------------------------------
+   * Error offsets
+   *  - a stream that cannot seek reports the same offsets as
+   *    memory, counted from the bytes read
+   */
+
+  // Hands over a few bytes per underflow and cannot seek, as
+  // a pipe does
+  struct PipeBuf : std::streambuf {
+    explicit
+    PipeBuf(std::string const& text) : text{ text } {
+    }
+
+    int_type underflow() override {
+      if (next == text.size()) {
+        return traits_type::eof();
+      }
+      size_t n = std::min<size_t>(3, text.size() - next);
+      std::memcpy(chunk, text.data() + next, n);
+      next += n;
+      setg(chunk, chunk, chunk + n);
+      return traits_type::to_int_type(chunk[0]);
+    }
+
+    std::string const& text;
+    size_t next = 0;
+    char chunk[3];
+  };
+
+  // Hands over its text in one piece, then throws, as a
+  // device or decompressor that fails does
+  struct ThrowingBuf : std::streambuf {
+    explicit
+    ThrowingBuf(std::string& text) {
+      setg(text.data(), text.data(), text.data() + text.size());
+    }
+
+    int_type underflow() override {
+      throw std::runtime_error("device failure");
+    }
+  };
+
+  std::vector<size_t> errorOffsets(cgf::ErrorSink const& errors) {
+    std::vector<size_t> offsets;
+    for (cgf::ScanError const& error : errors.errors()) {
+      offsets.push_back(error.offset);
+    }
+    return offsets;
+  }
+
+  void errorOffsets() {
+    std::string const text = "12 x 345 6y7 -8 \t99zz 10 ";
+    cgf::ErrorSink expected;
+    std::vector<int> const values = readAll(cgf::scan<int>(std::string_view(text), expected), cgf::untilEof<int>());
+    if (!checkEqual(expected.count(), size_t(3), "memory errors")) {
+      return;
+    }
+    {
+      cgf::ErrorSink errors;
+      PipeBuf buf(text);
+      std::istream in(&buf);
+      checkSame(readAll(cgf::scan<int>(in, errors, ParseMode::Buffered), cgf::untilEof<int>()), values);
+      checkSame(errorOffsets(errors), errorOffsets(expected));
+    }
+    {
+      // operator >> does not report the bytes it reads
+      cgf::ErrorSink errors;
+      PipeBuf buf(text);
+      std::istream in(&buf);
+      readAll(cgf::scan<int>(in, errors, ParseMode::Stream), cgf::untilEof<int>());
+      checkSame(errorOffsets(errors), std::vector<size_t>(errors.count(), cgf::ScanError::unknown));
+    }
+    {
+      PipeBuf buf(text);
+      std::istream in(&buf);
+      cgf::IstreamIterator<std::string_view> p = cgf::scan<std::string_view>(in, ParseMode::Buffered);
+      p.skip(3);
+      checkEqual(p.offset(), text.find(" 6y7"), "offset after skip");
+    }
+  }
+
+  // Skipping bad input reads on, so a failing source while
+  // skipping throws as it would while reading
+  void errorsFromSource() {
+    for (ParseMode mode : { ParseMode::Stream, ParseMode::Buffered }) {
+      Trace trace(mode == ParseMode::Stream ? "stream" : "buffered");
+      std::string text = "1 2 xx";
+      ThrowingBuf buf(text);
+      std::istream in(&buf);
+      cgf::ErrorSink errors;
+      bool threw = false;
+      try {
+        readAll(cgf::scan<int>(in, errors, mode), cgf::untilEof<int>());
+      }
+      catch (std::exception const&) {
+        threw = true;
+      }
+      check(threw || in.bad(), "source failure was lost");
+    }
+  }
+
+  /*------------------------------------------------------
+   * Reductions
+   *  - sums are accumulated wider than the values
+   */
+  void reduceSum() {
+    std::string text;
+    for (int i = 0; i < 3000; ++i) {
+      text += "2000000000 ";
+    }
+    auto total = cgf::sum(cgf::scan<int>(std::string_view(text)), cgf::untilEof<int>());
+    static_assert(std::is_same_v<decltype(total), long long>);
+    checkEqual(total, 6000000000000LL, "int sum");
+    checkEqual(cgf::sum<double>(cgf::scan<int>(std::string_view(text)), cgf::untilEof<int>()), 6e12, "int sum in double");
+
+    // 1 is below half an ulp of a float 1e8, so a float total
+    // would lose the ones
+    std::vector<float> values(8, 1e8f);
+    values.resize(16, 1.0f);
+    cgf::Sum<float, double> wide;
+    cgf::reduce(values.begin(), values.end(), wide);
+    checkEqual(wide.value(), 800000008.0, "float sum in double");
+    checkEqual(cgf::sum(values.begin(), values.end()), 8e8f, "float sum");
+  }
+
+  /*------------------------------------------------------
+   * Compressed input
+   */
+#if defined(CGF_HAS_ZLIB)
+  void gzipMembers() {
+    // concatenated members, then zero padding
+    std::string const first = corpus(Tokens::SmallInt);
+    std::string const second = corpus(Tokens::Word);
+    std::string const data = gzip(first) + gzip(second) + std::string(1000, '\0');
+    cgf::DecompressBuf decompress(std::string_view(data), cgf::Compression::Auto, smallBlock);
+    std::istream in(&decompress);
+    checkSame(readAll(cgf::scan<std::string>(in, ParseMode::Buffered), cgf::untilEof<std::string>()),
+              extracted<std::string>(first + second));
+  }
+
+  void gzipCorrupt() {
+    std::string data = gzip(corpus(Tokens::SmallInt));
+    data[data.size() / 2] ^= 0x55;
+    bool threw = false;
+    try {
+      cgf::DecompressBuf decompress(std::string_view(data), cgf::Compression::Gzip, smallBlock);
+      std::istream in(&decompress);
+      in.exceptions(std::ios_base::badbit);
+      readAll(cgf::scan<int>(in, ParseMode::Buffered), cgf::untilEof<int>());
+    }
+    catch (std::exception const&) {
+      threw = true;
+    }
+    check(threw, "corrupt input did not throw");
+  }
+#endif
+
+  /*------------------------------------------------------
+   * Output
+   *  - what a Writer writes reads back as the same values
+   */
+  template<typename T>
+  void checkRoundTrip(Tokens kind, size_t capacity) {
+    std::vector<T> const values = extracted<T>(corpus(kind));
+    std::ostringstream out;
+    {
+      cgf::OstreamIterator<T> sink(out, "\n", capacity);
+      std::copy(values.begin(), values.end(), sink);
+    }
+    std::string const text = out.str();
+    checkSame(readAll(cgf::scan<T>(std::string_view(text)), cgf::untilEof<T>()), values);
+  }
+
+  void writerRoundTrip() {
+    for (size_t capacity : { size_t(0), cgf::Writer::defaultCapacity }) {
+      Trace trace(capacity);
+      checkRoundTrip<int>(Tokens::SmallInt, capacity);
+      checkRoundTrip<long long>(Tokens::LargeInt, capacity);
+      checkRoundTrip<double>(Tokens::Real, capacity);
+      checkRoundTrip<std::string>(Tokens::LongWord, capacity);
+    }
+  }
+
+  void writerRecords() {
+    std::ostringstream out;
+    {
+      cgf::Writer writer(out);
+      writer.write(std::make_tuple(7, 2.5, std::string("abc")));
+      writer.put('\n');
+      writer.write(true);
+    }
+    checkEqual(out.str(), std::string("7 2.5 abc\n1"), "output");
+
+    // copies share the separator, which outlives the string
+    // it was made from
+    std::ostringstream listed;
+    {
+      cgf::OstreamIterator<int> sink(listed, std::string(", "));
+      cgf::OstreamIterator<int> copy = sink;
+      *copy++ = 1;
+      *sink++ = 2;
+    }
+    checkEqual(listed.str(), std::string("1, 2, "), "separated output");
+  }
+
+#if !defined(_WIN32)
+  void writerFileDescriptor() {
+    std::FILE* file = std::tmpfile();
+    if (!check(file != nullptr, "cannot create a temporary file")) {
+      return;
+    }
+    // as large as half the buffer, so it goes out with writev
+    std::string const large(300, 'x');
+    {
+      cgf::Writer writer(fileno(file), cgf::detail::minimumCapacity);
+      writer.write(12);
+      writer.put(' ');
+      writer.write(std::string_view(large));
+      writer.put(' ');
+      writer.write(-0.125);
+      writer.flush();
+      checkEqual(writer.written(), 3 + large.size() + 7, "written()");
+    }
+    std::rewind(file);
+    std::string written(1000, '\0');
+    written.resize(std::fread(written.data(), 1, written.size(), file));
+    std::fclose(file);
+    checkEqual(written, "12 " + large + " -0.125", "output");
+  }
+#endif
+
+  /*------------------------------------------------------
+   * Registration
+   */
+  struct Test {
+    char const* name;
+    void (*run)();
+  };
+
+  Test const tests[] = {
+    { "sources/small", sourcesSmallInt },
+    { "sources/large", sourcesLargeInt },
+    { "sources/real", sourcesReal },
+    { "sources/unsigned", sourcesUnsigned },
+    { "sources/rejected", sourcesRejected },
+    { "sources/word", sourcesWord },
+    { "sources/long", sourcesLongWord },
+    { "sources/string_view", sourcesStringView },
+#if defined(CGF_CPP20)
+    { "ranges/int", rangesInt },
+    { "ranges/real", rangesReal },
+    { "ranges/long", rangesLongWord },
+#endif
+#if defined(CGF_CPP20) && defined(__cpp_impl_coroutine)
+    { "async/int", asyncInt },
+    { "async/real", asyncReal },
+    { "async/long", asyncLongWord },
+#endif
+    { "sentinel/whole_tokens", sentinelWholeTokens },
+    { "sentinel/not_across_tokens", sentinelNotAcrossTokens },
+    { "skip/int", skipInt },
+    { "skip/real", skipReal },
+    { "skip/long", skipLongWord },
+    { "seek/offset", seekOffset },
+    { "index/scan_at", tokenIndex },
+    { "kernel/scalar", kernelsMatchScalar },
+    { "binary/records", binaryRecords },
+    { "errors/offset", errorOffsets },
+    { "errors/source_failure", errorsFromSource },
+    { "reduce/sum", reduceSum },
+#if defined(CGF_HAS_ZLIB)
+    { "gzip/members", gzipMembers },
+    { "gzip/corrupt", gzipCorrupt },
+#endif
+    { "writer/round_trip", writerRoundTrip },
+    { "writer/records", writerRecords },
+#if !defined(_WIN32)
+    { "writer/fd", writerFileDescriptor },
+#endif
+  };
+
+}
+
+int main(int argc, char** argv) {
+  size_t ran = 0;
+  for (Test const& test : tests) {
+    bool picked = argc < 2;
+    for (int i = 1; i < argc; ++i) {
+      picked = picked || std::strncmp(test.name, argv[i], std::strlen(argv[i])) == 0;
+    }
+    if (!picked) {
+      continue;
+    }
+    run.test = test.name;
+    size_t failures = run.failures;
+    try {
+      test.run();
+    }
+    catch (std::exception const& e) {
+      check(false, std::string("threw ") + e.what());
+    }
+    std::cout << (run.failures == failures ? "pass  " : "FAIL  ") << test.name << '\n';
+    ++ran;
+  }
+  std::cout << ran << " tests, " << run.checks << " checks, " << run.failures << " failed\n";
+  return run.failures || !ran ? 1 : 0;
+}